@@ -0,0 +1,48 @@
+# Packs resources into one archive for the Resources module. Run in script mode:
+#   cmake -DROOT=<res directory> -DARCHIVE=<output> -DFILES=<comma separated paths under ROOT> -P PackResources.cmake
+#
+# The archive is a text index followed by the files back to back:
+#   FLOXPACK 1
+#   <offset> <size> <path>    one line per file, offsets counted from the end of the index
+#   <empty line>
+#   <contents>
+
+if(NOT ROOT OR NOT ARCHIVE OR NOT FILES)
+    message(FATAL_ERROR "PackResources.cmake needs ROOT, ARCHIVE and FILES")
+endif()
+
+string(REPLACE "," ";" FILES "${FILES}")
+
+set(INDEX "FLOXPACK 1\n")
+set(OFFSET 0)
+set(CONTENTS "")
+foreach(FILE IN LISTS FILES)
+    set(PATH "${ROOT}/${FILE}")
+    if(NOT EXISTS "${PATH}")
+        message(FATAL_ERROR "Resource ${FILE} not found in ${ROOT}")
+    endif()
+
+    file(SIZE "${PATH}" SIZE)
+    string(APPEND INDEX "${OFFSET} ${SIZE} ${FILE}\n")
+    math(EXPR OFFSET "${OFFSET} + ${SIZE}")
+    list(APPEND CONTENTS "${PATH}")
+endforeach()
+string(APPEND INDEX "\n")
+
+# Contents go through cmake -E cat so they are copied byte for byte, whatever the platform does to text.
+get_filename_component(DIRECTORY "${ARCHIVE}" DIRECTORY)
+file(MAKE_DIRECTORY "${DIRECTORY}")
+file(WRITE "${ARCHIVE}.index" "${INDEX}")
+execute_process(
+    COMMAND "${CMAKE_COMMAND}" -E cat "${ARCHIVE}.index" ${CONTENTS}
+    OUTPUT_FILE "${ARCHIVE}.tmp"
+    RESULT_VARIABLE RESULT
+)
+file(REMOVE "${ARCHIVE}.index")
+
+if(NOT RESULT EQUAL 0)
+    file(REMOVE "${ARCHIVE}.tmp")
+    message(FATAL_ERROR "Failed to pack resources into ${ARCHIVE}")
+endif()
+
+file(RENAME "${ARCHIVE}.tmp" "${ARCHIVE}")
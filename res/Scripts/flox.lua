@@ -3,6 +3,48 @@ flox.world_bound = 500.0
 flox.width = 800
 flox.height = 450
 
+-- "auto" picks "tiled" for flocks up to tiled_crossover boids and "tree" above that.
+-- Only "tree" builds a quadtree, so the quadtree views (q and c) and tree-assisted view culling need it. With the
+-- default flock size "auto" picks "tiled".
+flox.algorithm = "auto"
+flox.tiled_crossover = 8192
+
+-- Square roots in the steering pass: "fast", "accurate" or "exact".
+flox.steering = "accurate"
+
+-- Build the next frame's tree while the current frame is integrated.
+flox.pipelined_tree = false
+
+-- Huge pages behind the flock: "off", "transparent" or "explicit". Linux only.
+flox.huge_pages = "off"
+
+-- Spread the flock's pages over every NUMA node instead of placing them by first touch. Linux only.
+flox.interleave = false
+
+-- Simulate straight into mapped GL memory the boids are drawn from, instead of copying and uploading every frame.
+-- Ignored with simulation_thread.
+flox.mapped_flock = false
+
+-- Send the GPU 8 bytes per boid, quantized to 16 bits per component, instead of full floats. Ignored with mapped_flock.
+flox.packed_instances = false
+
+-- Pin the main thread to a core of its own and each worker to one CPU, physical cores before SMT siblings.
+-- reserved_cores leaves that many cores to the rest of the system. thread_priority is a nice value. Linux only.
+flox.pin_threads = false
+flox.reserved_cores = 0
+flox.thread_priority = 0
+
+-- Step the simulation on its own thread. Frames then cost max(simulation, rendering) instead of the sum.
+flox.simulation_thread = false
+
+-- Draw boids as meshes when zoomed in, then as shaped sprites, then as single pixels, and hide vision circles that are
+-- too small to see. Off draws full meshes at every zoom.
+flox.level_of_detail = true
+
+-- Keep linked shader programs here so later runs load them instead of compiling. Entries are per driver and GPU, and
+-- sources that change simply miss. An empty string compiles every run.
+flox.shader_cache = "Data/ShaderCache"
+
 --frame_total = 0.0
 --frame_count = 0
 --total_average = 0.0
@@ -0,0 +1,31 @@
+#version 430 core
+
+layout(location = 0) in vec2 v_Rotation;
+out vec4 final;
+
+uniform vec3 color = vec3(1.0, 1.0, 1.0);
+
+// Which side of the edge from a to b the point is on. Positive to the left.
+float side(vec2 p, vec2 a, vec2 b) {
+    return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+void main() {
+    // The point covers the boid's bounding square. Turn its coordinates back into the shape's own space.
+    vec2 p = vec2(gl_PointCoord.x, 1.0 - gl_PointCoord.y) * 2.0 - 1.0;
+    vec2 local = vec2(dot(p, v_Rotation), dot(p, vec2(-v_Rotation.y, v_Rotation.x)));
+
+    // Same arrow as the filled mesh: a triangle with a notch cut out of its back.
+    const vec2 nose = vec2(1.0, 0.0);
+    const vec2 left = vec2(-0.707107, 0.707107);
+    const vec2 notch = vec2(-0.5, 0.0);
+    const vec2 right = vec2(-0.707107, -0.707107);
+
+    bool inTriangle = side(local, nose, left) >= 0.0 && side(local, left, right) >= 0.0 && side(local, right, nose) >= 0.0;
+    bool inNotch = side(local, left, notch) < 0.0 && side(local, notch, right) < 0.0;
+    if (!inTriangle || inNotch) {
+        discard;
+    }
+
+    final = vec4(color, 1.0);
+}
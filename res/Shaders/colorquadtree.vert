@@ -1,16 +1,24 @@
 #version 430 core
 
-layout(location = 0) in vec2 positions;
-layout(location = 1) in int depth;
+layout(location = 0) in vec2 center;
+layout(location = 1) in vec2 size;
+layout(location = 2) in int depth;
 
-uniform mat4 view = mat4(1.0);
-uniform mat4 projection = mat4(1.0);
+layout(std140, binding=0) uniform FrameUniforms {
+    mat4 projection;
+    mat4 view;
+    float dt;
+    float boidScale;
+};
 
 out VERTEX_DEPTH {
     flat int depth;
 } vs_depth;
 
+// The node's area, drawn as a triangle strip.
+const vec2 corners[4] = vec2[4](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
 void main() {
-    gl_Position = projection * view * vec4(positions, 0.0, 1.0);
+    gl_Position = projection * view * vec4(center + size * corners[gl_VertexID], 0.0, 1.0);
     vs_depth.depth = depth;
 }
@@ -2,8 +2,13 @@
 
 layout(location = 0) in vec4 position;
 
-uniform mat4 view = mat4(1.0);
-uniform mat4 projection = mat4(1.0);
+layout(std140, binding=0) uniform FrameUniforms {
+    mat4 projection;
+    mat4 view;
+    float dt;
+    float boidScale;
+};
+
 uniform vec3 offset = vec3(0.0);
 uniform float scale = 1.0f;
 
@@ -0,0 +1,32 @@
+#version 430 core
+
+layout(location = 0) in vec2 v_TexCoord;
+out vec4 final;
+
+layout(std430, binding=0) buffer rampColors {
+    vec4 colors[];
+};
+
+// Boid count in red, summed speed in green.
+layout(binding = 0) uniform sampler2D density;
+
+// Count that reaches the bright end of the ramp. Counts are compared on a log scale.
+uniform float saturation = 16.0;
+
+uniform bool bySpeed = false;
+uniform float maxSpeed = 1.0;
+
+void main() {
+    vec2 texel = texture(density, v_TexCoord).rg;
+    if (texel.r <= 0.0) {
+        discard;
+    }
+
+    float t = bySpeed ? texel.g / (texel.r * maxSpeed) : log(1.0 + texel.r) / log(1.0 + saturation);
+
+    // The palette runs from light to dark, the busiest texels get the lightest color.
+    float position = (1.0 - clamp(t, 0.0, 1.0)) * float(colors.length() - 1);
+    int low = int(position);
+    int high = min(low + 1, colors.length() - 1);
+    final = mix(colors[low], colors[high], fract(position));
+}
@@ -0,0 +1,10 @@
+#version 430 core
+
+layout(location = 0) out vec2 v_TexCoord;
+
+void main() {
+    // One triangle over the whole screen, straight from the vertex index.
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    v_TexCoord = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,9 @@
+#version 430 core
+
+layout(location = 0) in float speed;
+out vec4 final;
+
+// Blended additively, so each texel ends up with how many boids landed on it and their speeds summed.
+void main() {
+    final = vec4(1.0, speed, 0.0, 0.0);
+}
@@ -1,10 +1,18 @@
 #version 430 core
 
-layout(location = 0) in vec4 positions;
+layout(location = 0) in vec2 center;
+layout(location = 1) in vec2 size;
 
-uniform mat4 view = mat4(1.0);
-uniform mat4 projection = mat4(1.0);
+layout(std140, binding=0) uniform FrameUniforms {
+    mat4 projection;
+    mat4 view;
+    float dt;
+    float boidScale;
+};
+
+// The node's outline, drawn as a line loop.
+const vec2 corners[4] = vec2[4](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
 
 void main() {
-    gl_Position = projection * view * positions;
+    gl_Position = projection * view * vec4(center + size * corners[gl_VertexID], 0.0, 1.0);
 }
@@ -7,8 +7,12 @@ layout(location = 3) in vec4 color;
 
 out vec4 v_color;
 
-uniform mat4 view = mat4(1.0);
-uniform mat4 projection = mat4(1.0);
+layout(std140, binding=0) uniform FrameUniforms {
+    mat4 projection;
+    mat4 view;
+    float dt;
+    float boidScale;
+};
 
 void main() {
     gl_Position = projection * view * vec4(position * size + center, 0.0, 1.0);
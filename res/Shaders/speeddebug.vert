@@ -4,23 +4,53 @@ layout(location = 0) in vec4 position;
 layout(location = 1) in vec2 offset;
 layout(location = 2) in vec2 velocity;
 
-uniform mat4 view = mat4(1.0);
-uniform mat4 projection = mat4(1.0);
-uniform float scale = 10.0;
+layout(std140, binding=0) uniform FrameUniforms {
+    mat4 projection;
+    mat4 view;
+    float dt;
+    float boidScale;
+};
+
+// Side of the square drawn for each boid when the model is a single point.
+uniform float pointSize = 1.0;
+
+// Set when the instances are PackedBoids: 16 bit fixed point position over packedBounds (center, half size),
+// heading in turns and speed as a fraction of packedMaxSpeed.
+uniform bool packed = false;
+uniform vec4 packedBounds = vec4(0.0, 0.0, 1.0, 1.0);
+uniform float packedMaxSpeed = 1.0;
+
+const float UNORM16 = 1.0 / 65535.0;
+
+vec2 instanceOffset() {
+    return packed ? packedBounds.xy + (offset * (2.0 * UNORM16) - 1.0) * packedBounds.zw : offset;
+}
+
+vec2 instanceVelocity() {
+    if (!packed) {
+        return velocity;
+    }
+
+    float heading = velocity.x * UNORM16 * 6.28318531;
+    return velocity.y * UNORM16 * packedMaxSpeed * vec2(cos(heading), sin(heading));
+}
 
 layout(location = 0) out float v_VelocityLength;
 
 void main() {
-    float velocityLength = length(velocity);
-    vec2 rotation = velocity / velocityLength;
+    vec2 center = instanceOffset();
+    vec2 motion = instanceVelocity();
+    float velocityLength = length(motion);
+    vec2 rotation = motion / velocityLength;
     v_VelocityLength = velocityLength;
 
     mat4 model = mat4(
-        scale * rotation.x,  scale * rotation.y, 0.0, 0.0,
-        -scale * rotation.y, scale * rotation.x, 0.0, 0.0,
+        boidScale * rotation.x,  boidScale * rotation.y, 0.0, 0.0,
+        -boidScale * rotation.y, boidScale * rotation.x, 0.0, 0.0,
         0.0,                 0.0,                1.0, 0.0,
-        offset.x,            offset.y,           0.0, 1.0
+        center.x,            center.y,           0.0, 1.0
     );
 
     gl_Position = projection * view * model * position;
+    gl_PointSize = pointSize;
 }
@@ -1,18 +1,38 @@
-#version 430 core
+#version 460 core
 
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec2 offset;
 
-uniform mat4 view = mat4(1.0);
-uniform mat4 projection = mat4(1.0);
-uniform float scale = 10.0;
+layout(std140, binding=0) uniform FrameUniforms {
+    mat4 projection;
+    mat4 view;
+    float dt;
+    float boidScale;
+};
+
+// One radius per command of the multi-draw.
+layout(std430, binding=1) readonly buffer visionRadii {
+    float radii[];
+};
+
+// Set when the instances are PackedBoids: 16 bit fixed point position over packedBounds (center, half size).
+uniform bool packed = false;
+uniform vec4 packedBounds = vec4(0.0, 0.0, 1.0, 1.0);
+
+const float UNORM16 = 1.0 / 65535.0;
+
+vec2 instanceOffset() {
+    return packed ? packedBounds.xy + (offset * (2.0 * UNORM16) - 1.0) * packedBounds.zw : offset;
+}
 
 void main() {
+    vec2 center = instanceOffset();
+    float scale = radii[gl_DrawID];
     mat4 model = mat4(
     scale,    0.0,      0.0, 0.0,
     0.0,      scale,    0.0, 0.0,
     0.0,      0.0,      1.0, 0.0,
-    offset.x, offset.y, 0.0, 1.0
+    center.x, center.y, 0.0, 1.0
     );
 
     gl_Position = projection * view * model * position;
@@ -1,6 +1,8 @@
 #include "pch.hpp"
 #include "DirectComputeAgent.hpp"
 
+import Resources;
+
 
 void DirectComputeAgent::delete_buffer(const GLuint id) {
     if (id == 0) { return; }
@@ -51,10 +53,15 @@ void DirectComputeAgent::validate_program(const GLuint id, const GLenum stage) {
 }
 
 GLuint DirectComputeAgent::compile() {
-    const std::string source {read_file("Data/Shaders/direct.compute")};
+    const std::string_view source {Resources::get().load("Shaders/direct.compute")};
     const GLuint program = glCreateProgram();
+    const std::string key {lwvl::ProgramCache::key({source})};
+    if (lwvl::ProgramCache::load(program, key)) {
+        return program;
+    }
+
     const GLuint shader {glCreateShader(GL_COMPUTE_SHADER)};
-    const GLchar* src {source.c_str()};
+    const GLchar* src {source.data()};
     const auto length {static_cast<GLint>(source.length())};
     glShaderSource(shader, 1, &src, &length);
     glCompileShader(shader);
@@ -66,26 +73,13 @@ GLuint DirectComputeAgent::compile() {
 
     glValidateProgram(program);
     validate_program(program, GL_VALIDATE_STATUS);
+    lwvl::ProgramCache::store(program, key);
 
     glDetachShader(program, shader);
     glDeleteShader(shader);
     return program;
 }
 
-std::string DirectComputeAgent::read_file(const char* path) {
-    // Handle errors on this.
-    // Compilation acts as a sort of error handling.
-    std::ifstream file {path};
-    std::stringstream output_stream;
-
-    std::string line;
-    while (getline(file, line)) {
-        output_stream << line << '\n';
-    }
-
-    return output_stream.str();
-}
-
 void DirectComputeAgent::resize_buffers(std::size_t count) {
     const size_t buffer_size = count * sizeof(Boid);
     const auto gl_buffer_size = static_cast<GLsizeiptr>(buffer_size);
@@ -18,7 +18,6 @@ class DirectComputeAgent final : public ComputeAgent {
     static void validate_shader(GLuint id);
     static void validate_program(GLuint id, GLenum stage);
     static GLuint compile();
-    static std::string read_file(const char* path);
 
     void resize_buffers(std::size_t count);
     void write_uniforms(float delta) const;
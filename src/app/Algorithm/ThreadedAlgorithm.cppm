@@ -6,10 +6,32 @@ export import Algorithm;
 import Boid;
 import Boidtree;
 import DoubleBuffer;
-import RawArray;
+import Parallel;
 import Rectangle;
+import Steering;
+import WorkerTeam;
 
-constexpr ptrdiff_t BOID_GROUP = 8;
+constexpr ptrdiff_t BOID_GROUP = SearchPacketSize;
+
+// Bounding box and top speed of a set of boids.
+struct Extent {
+    Vector low {std::numeric_limits<float>::max()};
+    Vector high {std::numeric_limits<float>::lowest()};
+    float top_speed2 = 0.0f;
+
+    void add(Boid const &boid) {
+        low = {std::min(low.x, boid.position.x), std::min(low.y, boid.position.y)};
+        high = {std::max(high.x, boid.position.x), std::max(high.y, boid.position.y)};
+        top_speed2 = std::max(top_speed2, glm::length2(boid.velocity));
+    }
+
+    friend Extent join(Extent a, Extent const &b) {
+        a.low = {std::min(a.low.x, b.low.x), std::min(a.low.y, b.low.y)};
+        a.high = {std::max(a.high.x, b.high.x), std::max(a.high.y, b.high.y)};
+        a.top_speed2 = std::max(a.top_speed2, b.top_speed2);
+        return a;
+    }
+};
 
 
 export class ThreadedAlgorithm;
@@ -33,129 +55,289 @@ struct ThreadWork {
 
 export class ThreadedAlgorithm final : public Algorithm {
     void populate_tree(const Boid *read, const ptrdiff_t count) {
-        m_tree.clear();
+        // Built as a grid of cells that are each their own small tree, then grafted together.
+        // Sorting by cell is stable, so every cell sees its boids in the same order one by one insertion would. The shape
+        // is not the same though: the top CellLevels are always subdivided, even where a single bucket would have held
+        // every boid below them.
         m_tree.bounds = m_treeBounds;
-        for (Boid const &boid: RawArray(read, count)) {
-            m_tree.insert(&boid, boid.position);
+        m_cell_keys.resize(count);
+        m_cell_items.resize(count);
+        m_key_scratch.resize(count);
+        m_item_scratch.resize(count);
+
+        parallel_for(
+            m_team, RawArray(m_cell_keys.data(), count), [&](RawArray<uint32_t> keys, const ptrdiff_t first) {
+                for (ptrdiff_t k = 0; k < static_cast<ptrdiff_t>(keys.size()); ++k) {
+                    // Outside the tree sorts last.
+                    const ptrdiff_t cell = m_tree.cell(read[first + k].position, CellLevels);
+                    keys[k] = static_cast<uint32_t>(cell < 0 ? CellCount : cell);
+                    m_cell_items[first + k] = static_cast<uint32_t>(first + k);
+                }
+            }
+        );
+
+        radix_sort(
+            m_team, RawArray(m_cell_keys.data(), count), RawArray(m_cell_items.data(), count),
+            RawArray(m_key_scratch.data(), count), RawArray(m_item_scratch.data(), count), static_cast<int>(std::bit_width(CellCount))
+        );
+
+        std::array<ptrdiff_t, CellCount + 1> starts {};
+        for (size_t cell = 0; cell <= CellCount; ++cell) {
+            starts[cell] = std::lower_bound(m_cell_keys.begin(), m_cell_keys.end(), cell) - m_cell_keys.begin();
+        }
+
+        for (Fold &fold: m_folds) {
+            fold.overflow.clear();
+        }
+
+        m_team.parallel_for(
+            0, static_cast<ptrdiff_t>(CellCount), 1, [&](const int id, const ptrdiff_t first, const ptrdiff_t last) {
+                for (ptrdiff_t cell = first; cell < last; ++cell) {
+                    Boidtree &tree = m_cells[cell];
+                    tree.clear();
+                    tree.bounds = m_tree.cell_bounds(cell, CellLevels);
+                    for (ptrdiff_t k = starts[cell]; k < starts[cell + 1]; ++k) {
+                        const uint32_t i = m_cell_items[k];
+                        if (!tree.insert(read + i, read[i].position)) {
+                            m_folds[id].overflow.push_back(i);
+                        }
+                    }
+                }
+            }
+        );
+
+        graft_cells(m_tree);
+
+        // Outside the tree. Nobody can see them, but they still have to move.
+        m_order.assign(m_cell_items.begin() + starts[CellCount], m_cell_items.end());
+        for (Fold const &fold: m_folds) {
+            m_order.insert(m_order.end(), fold.overflow.begin(), fold.overflow.end());
+        }
+    }
+
+    void graft_cells(Boidtree &tree) {
+        tree.begin_graft(CellLevels, m_cells, m_node_offsets, m_bucket_offsets);
+        m_team.parallel_for(
+            0, static_cast<ptrdiff_t>(CellCount), 1, [&](int, const ptrdiff_t first, const ptrdiff_t last) {
+                for (ptrdiff_t cell = first; cell < last; ++cell) {
+                    tree.graft(m_cells[cell], m_node_offsets[cell], m_bucket_offsets[cell]);
+                }
+            }
+        );
+    }
+
+    void order_work(const Boid *read) {
+        // Work is handed out along a Hilbert curve over the tree's leaves rather than by flock index.
+        // A chunk of the order is a compact patch of the world, so a thread keeps searching the same few nodes and
+        //   reading the same neighbors instead of touching the whole tree.
+        const size_t stragglers = m_order.size();
+        m_tree.visit_hilbert([this, read](const Boid *boid) { m_order.push_back(static_cast<uint32_t>(boid - read)); });
+        std::rotate(m_order.begin(), m_order.begin() + static_cast<ptrdiff_t>(stragglers), m_order.end());
+    }
+
+    void partition_work(const ptrdiff_t count) {
+        const auto chunk_total = static_cast<ptrdiff_t>(m_chunks.size()) - 1;
+        // Last frame's cost is the best guess for this frame's. Boids keep their index across frames.
+        if (static_cast<ptrdiff_t>(m_costs.size()) != count) {
+            m_costs.assign(count, 1);
+        }
+
+        // Running (prefix) sum of costs in work order. m_prefix[i + 1] is the cost of everything up to and including i.
+        m_prefix.resize(count + 1);
+        parallel_for(
+            m_team, RawArray(m_prefix.data(), count), [this](RawArray<uint64_t> costs, const ptrdiff_t first) {
+                for (ptrdiff_t k = 0; k < static_cast<ptrdiff_t>(costs.size()); ++k) {
+                    costs[k] = m_costs[m_order[first + k]];
+                }
+            }
+        );
+
+        const uint64_t total_cost = exclusive_scan(
+            m_team, RawArray(m_prefix.data(), count), RawArray(m_prefix.data(), count), uint64_t {0}, std::plus<> {}
+        );
+        m_prefix[count] = total_cost;
+
+        // Cut a chunk where the running sum crosses each equal share. Cuts land on group boundaries.
+        m_chunks[0] = 0;
+        for (ptrdiff_t chunk = 1; chunk < chunk_total; ++chunk) {
+            const uint64_t target = total_cost * chunk / chunk_total;
+            const ptrdiff_t i = std::lower_bound(m_prefix.begin() + 1, m_prefix.end(), target) - m_prefix.begin() - 1;
+            const ptrdiff_t cut = std::min((i + BOID_GROUP) / BOID_GROUP * BOID_GROUP, count);
+            m_chunks[chunk] = std::max(cut, m_chunks[chunk - 1]);
         }
+        m_chunks[chunk_total] = count;
     }
 
     void distribute_work(const Boid *read, Boid *write, const ptrdiff_t count, const float delta) {
-        // Maybe compute these values only when flock size changes?
-        // Compiler should see div/mod and combine operations.
-        // Number of groups of boids.
-        const ptrdiff_t boid_groups = count / BOID_GROUP;
-
-        // Number of boids outside a group. Always less than boid group size. Fine. I'll process them myself.
-        const ptrdiff_t leftover_boids = count % BOID_GROUP;
-
-        // Number of boid groups per thread. 0 if less than ThreadCount groups.
-        const ptrdiff_t boid_groups_per_thread = boid_groups / ThreadCount;
-
-        // Number of groups not evenly distributed across the threads. Evenly distribute them across the threads.
-        ptrdiff_t leftover_groups = boid_groups % ThreadCount;
-        const ptrdiff_t boids_per_thread = BOID_GROUP * boid_groups_per_thread;
-
-        //std::cout << '\n'
-        //          << boid_groups << " groups.\n"
-        //          << boid_groups_per_thread << " groups per thread.\n"
-        //          << leftover_groups << " leftover groups.\n"
-        //          << leftover_boids << " leftover boids.\n";
-
-        // Leftover boids have to be added to the last thread.
-        // The last thread only takes a leftover group if there are no leftover boids.
-        // If the first thread took two birds extra, each of the other threads' processing would start offset by two.
-
-        const bool primary_thread_needs_work = !(boids_per_thread || leftover_boids);
-
-        // See if we need to take a group here.
-        const ptrdiff_t final_start {
-            primary_thread_needs_work ?
-            BOID_GROUP * (boid_groups_per_thread * (ThreadCount - 1) + leftover_groups - (leftover_groups > 0)) :
-            BOID_GROUP * (boid_groups_per_thread * (ThreadCount - 1) + leftover_groups)
-        };
-
-        // Take the group here.
-        const ptrdiff_t final_count {
-            primary_thread_needs_work ?
-            boids_per_thread + leftover_boids + (leftover_groups-- > 0) * BOID_GROUP :
-            boids_per_thread + leftover_boids
-        };
-
-        ThreadFutures futures {};
-        if (boid_groups_per_thread > 0 || leftover_groups > 0) {
-            ptrdiff_t next_start = 0;
-            for (int i = 0; i < ThreadCount - 1; ++i) {
-                if (boid_groups_per_thread == 0 && leftover_groups <= 0) { break; }
-                futures[i] = m_pool.submit(
-                    [](ThreadWork thread_work) { thread_work(); },
-                    ThreadWork {
-                        this, i, delta,
-                        read, write,
-                        boids_per_thread + (leftover_groups > 0) * BOID_GROUP,  // I might take a group below.
-                        next_start
+        // Chunks carry roughly equal estimated work. Whoever is free takes the next one, which flattens the tail
+        //   where one thread holds up the frame when the estimate is off.
+        partition_work(count);
+
+        const auto chunk_total = static_cast<ptrdiff_t>(m_chunks.size()) - 1;
+        std::atomic<ptrdiff_t> next_chunk {0};
+        m_team.run(
+            [&](const int id) {
+                while (true) {
+                    const ptrdiff_t chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+                    if (chunk >= chunk_total) {
+                        return;
+                    }
+
+                    const ptrdiff_t start = m_chunks[chunk];
+                    const ptrdiff_t chunk_count = m_chunks[chunk + 1] - start;
+                    if (chunk_count > 0) {
+                        ThreadWork {this, id, delta, read, write, chunk_count, start}();
+                        if (m_pipelined) {
+                            stage_next(id, write, chunk_count, start);
+                        }
                     }
-                );
+                }
+            }
+        );
+    }
+
+    [[nodiscard]] Extent measure(const Boid *boids, const ptrdiff_t count) {
+        return reduce(
+            m_team, RawArray(boids, count), Extent {}, [](RawArray<const Boid> slice) {
+                Extent extent {};
+                for (Boid const &boid: slice) {
+                    extent.add(boid);
+                }
+                return extent;
+            }, [](Extent const &a, Extent const &b) { return join(a, b); }
+        );
+    }
+
+    void recalculate_bounds(const Boid *write, const ptrdiff_t count) {
+        const Extent extent = measure(write, count);
+        grow_bounds(extent.low, extent.high);
+    }
 
-                next_start += boids_per_thread + (leftover_groups-- > 0) * BOID_GROUP;  // Take a group here.
+    void grow_bounds(const Vector low, const Vector high) {
+        const Vector current_low {m_treeBounds.center - m_treeBounds.size};
+        const Vector current_high {m_treeBounds.center + m_treeBounds.size};
+        const Vector new_low {std::min(low.x, current_low.x), std::min(low.y, current_low.y)};
+        const Vector new_high {std::max(high.x, current_high.x), std::max(high.y, current_high.y)};
+        m_treeBounds = Rectangle {(new_low + new_high) * 0.5f, (new_high - new_low) * 0.5f};
+    }
+
+    // Pipelined tree construction.
+    // . The tree for the next frame is built while this frame is integrated. As soon as a chunk is integrated, its
+    //   boids go into the next tree, binned into a fixed grid of cells that are each their own small tree.
+    // . Chunks are compact patches of the world, so a chunk touches few cells and the per-cell locks rarely collide.
+    // . The next tree's bounds have to be known before anything moves. Every boid moves at most top speed * delta, so
+    //   the current bounds grown by that much hold all of them. Anything that still falls outside is kept aside and
+    //   worked on like any other boid outside the tree.
+    // . The bounds and top speed the frame after needs are folded into the same pass.
+    void bootstrap(const Boid *read, const ptrdiff_t count) {
+        // No previous pass to learn from. Measure the flock directly.
+        const Extent extent = measure(read, count);
+        grow_bounds(extent.low, extent.high);
+        m_top_speed = std::sqrt(extent.top_speed2);
+    }
+
+    void begin_next_tree(const float delta) {
+        // A little extra for rounding in the integration.
+        const float margin = m_top_speed * delta * 1.01f + 1.0f;
+        m_next_tree.bounds = Rectangle {m_treeBounds.center, m_treeBounds.size + Vector {margin}};
+        for (size_t cell = 0; cell < CellCount; ++cell) {
+            m_cells[cell].clear();
+            m_cells[cell].bounds = m_next_tree.cell_bounds(cell, CellLevels);
+        }
+
+        for (Fold &fold: m_folds) {
+            fold.extent = Extent {};
+            fold.overflow.clear();
+        }
+    }
+
+    void stage_next(const int id, const Boid *write, const ptrdiff_t count, const ptrdiff_t start) {
+        Fold &fold = m_folds[id];
+        fold.cells.resize(count);
+        fold.binned.resize(count);
+
+        // Bin the chunk by cell, folding bounds and speed along the way.
+        std::array<uint32_t, CellCount + 1> offsets {};
+        for (ptrdiff_t k = 0; k < count; ++k) {
+            const uint32_t i = m_order[start + k];
+            Boid const &boid = write[i];
+            fold.extent.add(boid);
+
+            const ptrdiff_t cell = m_next_tree.cell(boid.position, CellLevels);
+            fold.cells[k] = static_cast<int32_t>(cell);
+            if (cell < 0) {
+                fold.overflow.push_back(i);
+            } else {
+                ++offsets[cell + 1];
             }
         }
 
-        //Do my work.
-        ThreadWork {this, ThreadCount - 1, delta, read, write, final_count, final_start}();
+        for (size_t cell = 0; cell < CellCount; ++cell) {
+            offsets[cell + 1] += offsets[cell];
+        }
 
-        // Wait for the others to finish their work.
-        for (auto &update_future: futures) {
-            if (update_future.valid()) {
-                update_future.get();
+        std::array<uint32_t, CellCount> cursors {};
+        std::copy(offsets.begin(), offsets.end() - 1, cursors.begin());
+        for (ptrdiff_t k = 0; k < count; ++k) {
+            if (fold.cells[k] >= 0) {
+                fold.binned[cursors[fold.cells[k]]++] = m_order[start + k];
             }
         }
-    }
 
-    void recalculate_bounds(Boid *write, const ptrdiff_t count) {
-        // Separate loop for thread-safety. Does this slow the program down?
-        // Maybe have an array where the results of this test from each thread are stored and join them after.
-        Vector x_bound {m_treeBounds.center.x - m_treeBounds.size.x, m_treeBounds.center.x + m_treeBounds.size.x};
-        Vector y_bound {m_treeBounds.center.y - m_treeBounds.size.y, m_treeBounds.center.y + m_treeBounds.size.y};
-        for (auto const &current: RawArray(write, count)) {
-            if (current.position.x < x_bound.r) {
-                x_bound.r = current.position.x;
-            } else if (current.position.x > x_bound.g) {
-                x_bound.g = current.position.x;
+        // One lock per touched cell. Tree items point into the write buffer, which is the read buffer after the flip.
+        for (size_t cell = 0; cell < CellCount; ++cell) {
+            if (offsets[cell] == offsets[cell + 1]) {
+                continue;
             }
 
-            if (current.position.y < y_bound.r) {
-                y_bound.r = current.position.y;
-            } else if (current.position.y > y_bound.g) {
-                y_bound.g = current.position.y;
+            std::lock_guard<std::mutex> lock {m_cell_locks[cell]};
+            for (uint32_t b = offsets[cell]; b < offsets[cell + 1]; ++b) {
+                const uint32_t i = fold.binned[b];
+                if (!m_cells[cell].insert(write + i, write[i].position)) {
+                    fold.overflow.push_back(i);
+                }
             }
         }
+    }
 
-        float x_bound_center = (x_bound.r + x_bound.g) * 0.5f;
-        float y_bound_center = (y_bound.r + y_bound.g) * 0.5f;
+    // next_read is the buffer the next frame reads, which the next tree's items point into.
+    void finish_next_tree(const Boid *next_read, const ptrdiff_t count) {
+        graft_cells(m_next_tree);
 
-        Rectangle newBounds {
-            {x_bound_center,             y_bound_center},
-            {x_bound.g - x_bound_center, y_bound.g - y_bound_center}
-        };
+        Extent extent {};
+        m_overflow.clear();
+        for (Fold const &fold: m_folds) {
+            extent = join(extent, fold.extent);
+            m_overflow.insert(m_overflow.end(), fold.overflow.begin(), fold.overflow.end());
+        }
 
-        m_treeBounds = newBounds;
+        grow_bounds(extent.low, extent.high);
+        m_top_speed = std::sqrt(extent.top_speed2);
+        m_next_read = next_read;
+        m_next_count = count;
     }
 
     friend ThreadWork;
 
 public:
-    explicit ThreadedAlgorithm(Vector b) : m_bounds(b), m_treeBounds(m_bounds), m_tree(m_treeBounds) {
-        for (auto &m_result: m_results) {
-            m_result.reserve(128);
+    ThreadedAlgorithm(Vector b, WorkerTeam &team, const bool pipelined = false) :
+        m_bounds(b), m_treeBounds(m_bounds), m_tree(m_treeBounds), m_team(team), m_results(team.size()),
+        m_chunks(team.size() * ChunksPerParticipant + 1), m_pipelined(pipelined), m_next_tree(m_treeBounds),
+        m_folds(team.size())
+    {
+        for (auto &participant_results: m_results) {
+            for (auto &member_results: participant_results) {
+                member_results.reserve(128);
+            }
         }
 
-        m_pool.init();
+        m_cells.reserve(CellCount);
+        for (size_t cell = 0; cell < CellCount; ++cell) {
+            m_cells.emplace_back(m_treeBounds, Boidtree::MaxDepth - CellLevels);
+        }
     }
 
-    ~ThreadedAlgorithm() override {
-        m_pool.shutdown();
-    }
+    ~ThreadedAlgorithm() override = default;
 
     void update(DoubleBuffer<Boid> &boids, const float delta) override {
         const auto count = static_cast<ptrdiff_t>(boids.count());
@@ -164,31 +346,99 @@ public:
         const Boid *read = boids.read();
         Boid *write = boids.write();
 
-        // Insert the boids into the quadtree
-        populate_tree(boids.read(), count);
+        if (m_pipelined && m_next_read == read && m_next_count == count) {
+            // Built during the last frame's pass.
+            std::swap(m_tree, m_next_tree);
+            m_order.assign(m_overflow.begin(), m_overflow.end());
+        } else {
+            if (m_pipelined) {
+                bootstrap(read, count);
+            }
+
+            // Insert the boids into the quadtree
+            populate_tree(boids.read(), count);
+        }
+        order_work(read);
+        m_tree_source = read;
+
+        if (m_pipelined) {
+            begin_next_tree(delta);
+        }
 
         // Distribute the calculation work evenly among the available threads.
         distribute_work(read, write, count, delta);
 
-        // Recalculate the bounds of the quadtree to keep the birds inside.
-        recalculate_bounds(boids.write(), count);
+        if (m_pipelined) {
+            finish_next_tree(write, count);
+        } else {
+            // Recalculate the bounds of the quadtree to keep the birds inside.
+            recalculate_bounds(write, count);
+        }
     }
 
     [[nodiscard]] Boidtree const &tree() const {
         return m_tree;
     }
+
+    // The flock tree() was built from. After the update's flip that is the buffer being written, not the one read.
+    [[nodiscard]] Boid const *tree_source() const {
+        return m_tree_source;
+    }
 private:
-    static constexpr int ThreadCount = 8;
-    using ThreadFutures = std::array<std::future<void>, ThreadCount - 1>;
-    using QuadtreeResults = std::vector<Boid>;
+    static constexpr ptrdiff_t ChunksPerParticipant = 8;
 
     Rectangle m_bounds;
     Rectangle m_treeBounds;
     Boidtree m_tree;
+    const Boid *m_tree_source = nullptr;
     //std::mutex m_mutex;
 
-    ThreadPool m_pool {ThreadCount - 1};
-    QuadtreeResults m_results[ThreadCount];
+    WorkerTeam &m_team;
+
+    // Search results per participant, reused by every chunk it takes so they stay warm and keep their capacity.
+    std::vector<PacketResults> m_results;
+
+    // Neighbor candidates each boid saw last frame, plus one for the fixed per-boid work.
+    std::vector<uint32_t> m_costs;
+
+    // Flock indices in the order they are worked on. Chunks are ranges of this.
+    std::vector<uint32_t> m_order;
+    std::vector<ptrdiff_t> m_chunks;
+    std::vector<uint64_t> m_prefix;
+
+    // Trees are built as 4^CellLevels cells in parallel and grafted together.
+    static constexpr size_t CellLevels = 3;
+    static constexpr size_t CellCount = size_t {1} << 2 * CellLevels;
+    std::vector<uint32_t> m_cell_keys;
+    std::vector<uint32_t> m_cell_items;
+    std::vector<uint32_t> m_key_scratch;
+    std::vector<uint32_t> m_item_scratch;
+
+    // Per participant, so passes fold without sharing cache lines.
+    struct alignas(64) Fold {
+        Extent extent;
+        std::vector<uint32_t> overflow;
+
+        // Binning scratch for one chunk at a time. Kept across chunks and frames so it keeps its capacity.
+        std::vector<int32_t> cells;
+        std::vector<uint32_t> binned;
+    };
+
+    bool m_pipelined;
+    Boidtree m_next_tree;
+    std::vector<Boidtree> m_cells;
+    std::array<std::mutex, CellCount> m_cell_locks;
+    std::vector<size_t> m_node_offsets;
+    std::vector<size_t> m_bucket_offsets;
+    std::vector<Fold> m_folds;
+
+    // Boids outside the next tree. They lead next frame's work order.
+    std::vector<uint32_t> m_overflow;
+    float m_top_speed = 0.0f;
+
+    // The read buffer and flock size the next tree was built for. Anything else means it has to be rebuilt.
+    const Boid *m_next_read = nullptr;
+    ptrdiff_t m_next_count = -1;
 };
 
 
@@ -199,97 +449,55 @@ void ThreadWork::operator()() const {
     //}
     const Boidtree &tree = algorithm->m_tree;
     const Rectangle bounds = algorithm->m_bounds;
-    auto &results = algorithm->m_results[id];
+    PacketResults &results = algorithm->m_results[id];
+    uint32_t *costs = algorithm->m_costs.data();
+    const uint32_t *order = algorithm->m_order.data();
     const float disruptive_radius = Boid::disruptiveRadius * Boid::disruptiveRadius;
     const float cohesive_radius = Boid::cohesiveRadius * Boid::cohesiveRadius;
 
-    const Rectangle center_bound{bounds * 0.75f};
-    const Rectangle hard_bound{bounds * 0.90f};
-
-    Rectangle search_bound{Vector{Boid::cohesiveRadius}};
-    for (ptrdiff_t i = start; i < start + count; ++i) {
-        const Boid current = read[i];
-        const Boid *previous = read + i;
-
-        search_bound.center = current.position;
-        Vector center_steer{0.0f, 0.0f};
-
-        const bool in_center = center_bound.contains(current.position);
-        float center_steer_weight = Boid::primadonnaWeight;
-        if (!in_center) {
-            if (!hard_bound.contains(current.position)) {
-                center_steer_weight *= 2.0f;
-            }
-
-            center_steer -= current.position;
-            center_steer = steer(center_steer, current.velocity);
+    const Vector search_size {Boid::cohesiveRadius};
+    SearchPacket packet {};
+    SteeringBatch batch {};
+    for (ptrdiff_t first = start; first < start + count; first += BOID_GROUP) {
+        // One traversal per group. Consecutive boids in the work order sit next to each other, so their searches
+        //   overlap almost entirely.
+        packet.size = static_cast<size_t>(std::min(BOID_GROUP, start + count - first));
+        for (size_t m = 0; m < packet.size; ++m) {
+            const ptrdiff_t i = order[first + static_cast<ptrdiff_t>(m)];
+            packet.selves[m] = read + i;
+            packet.areas[m] = Rectangle {read[i].position, search_size};
+            results[m].clear();
         }
 
-        const Vector full_speed = steer(current.velocity, current.velocity);
-
-        results.clear();
-        search(tree, previous, search_bound, results);
-        //std::sort(
-        //    results.begin(), results.end(),
-        //    [&current](const Boid &a, const Boid &b) {
-        //        return glm::distance2(current.position, a.position) < glm::distance2(current.position, b.position);
-        //    }
-        //);
-
-        Vector separation{0.0f, 0.0f};
-        Vector alignment{0.0f, 0.0f};
-        Vector cohesion{0.0f, 0.0f};
-        size_t cohesive_total = 0;
-        size_t disruptive_total = 0;
-
-        for (const Boid &other : results) {
-            const float d2 = glm::distance2(current.position, other.position);
-
-            const size_t is_disruptive = d2 < disruptive_radius;
-            const size_t is_cohesive = d2 < cohesive_radius;
-
-            separation += FloatEnable[is_disruptive] * ((current.position - other.position) / (d2 + Epsilon));
-            alignment += FloatEnable[is_cohesive] * other.velocity;
-            cohesion += FloatEnable[is_cohesive] * other.position;
-
-            disruptive_total += is_disruptive;
-            cohesive_total += is_cohesive;
-
-            //if (d2 < disruptiveRadius) {
-            //    separation += (current.position - other.position) / d2 + epsilon;
-            //    disruptive_total++;
-            //}
-
-            //if (d2 < cohesiveRadius) {
-            //    alignment += other.velocity;
-            //    cohesion += other.position;
-            //    cohesive_total++;
-            //}
-        }
+        search(tree, packet, results);
 
-        if (disruptive_total > 0) {
-            separation /= static_cast<float>(disruptive_total);
-            separation = steer(separation, current.velocity);
-        }
+        for (size_t m = 0; m < packet.size; ++m) {
+            const ptrdiff_t i = packet.selves[m] - read;
+            const Boid current = read[i];
+            const std::vector<Boid> &neighbors = results[m];
+            costs[i] = static_cast<uint32_t>(neighbors.size()) + 1;
 
-        if (cohesive_total > 0) {
-            const float countFactor = 1.0f / static_cast<float>(cohesive_total);
-            alignment *= countFactor;
+            Neighborhood neighborhood {};
+            for (const Boid &other : neighbors) {
+                const float d2 = glm::distance2(current.position, other.position);
 
-            cohesion *= countFactor;
-            cohesion -= current.position;
+                const size_t is_disruptive = d2 < disruptive_radius;
+                const size_t is_cohesive = d2 < cohesive_radius;
 
-            alignment = steer(alignment, current.velocity);
-            cohesion = steer(cohesion, current.velocity);
-        }
+                neighborhood.separation += FloatEnable[is_disruptive] * ((current.position - other.position) / (d2 + Epsilon));
+                neighborhood.alignment += FloatEnable[is_cohesive] * other.velocity;
+                neighborhood.cohesion += FloatEnable[is_cohesive] * other.position;
 
-        const Vector acceleration = magnitude(
-            Vector{center_steer * center_steer_weight + full_speed * Boid::speedWeight +
-                   separation * Boid::separationWeight + alignment * Boid::alignmentWeight +
-                   cohesion * Boid::cohesionWeight},
-            Boid::maxForce);
+                neighborhood.disruptive_total += FloatEnable[is_disruptive];
+                neighborhood.cohesive_total += FloatEnable[is_cohesive];
+            }
 
-        write[i].velocity += acceleration;
-        write[i].position += current.velocity * delta;
+            batch.push(static_cast<uint32_t>(i), current, neighborhood);
+            if (batch.full()) {
+                integrate(batch, bounds, read, write, delta);
+            }
+        }
     }
+
+    integrate(batch, bounds, read, write, delta);
 }
@@ -10,15 +10,27 @@
 #include "binary_default_lua.cpp"
 
 // #define FLOX_DEBUG_TIMINGS
+// #define FLOX_STEERING_REPORT
 
 import Boid;
 import Camera;
+import DoubleBuffer;
 import Flock;
+import FlockCuller;
 import FlockRenderer;
+import FrameArena;
+import FrameUniforms;
+import HeatmapRenderer;
 import Rectangle;
 import RectangleRenderer;
+import Resources;
+import SimulationThread;
+import TaskGraph;
+import Steering;
 import ThreadedAlgorithm;
+import TiledAlgorithm;
 import QuadtreeRenderer;
+import WorkerTeam;
 
 using namespace lwvl::debug;
 using namespace std::chrono;
@@ -71,33 +83,102 @@ namespace app {
         int width;
         int height;
     };
+
+    struct AlgorithmConfiguration {
+        // "auto", "tree" or "tiled".
+        std::string backend;
+
+        // Flocks of at most this many boids use the tiled backend when the backend is "auto".
+        size_t tiled_crossover;
+
+        // "fast", "accurate" or "exact" square roots in the steering pass.
+        std::string steering;
+
+        // Build the tree backend's next tree during the current update instead of before the next one.
+        bool pipelined_tree;
+    };
+
+    struct MemoryConfiguration {
+        // "off", "transparent" or "explicit" huge pages behind the flock.
+        std::string huge_pages;
+
+        // Interleave the flock's pages over every NUMA node.
+        bool interleave;
+
+        // Keep the flock in persistently mapped GL storage that the boid models draw from directly.
+        bool mapped_flock;
+
+        // Draw from 8 byte quantized instances instead of whole boids. Ignored while the flock is mapped.
+        bool packed_instances;
+    };
+
+    struct RenderConfiguration {
+        // Draw boids as meshes, sprites or points depending on how large they come out at the current zoom.
+        bool level_of_detail;
+
+        // Directory for linked shader programs, so later runs skip compiling them. Empty compiles every run.
+        std::string shader_cache;
+    };
+
+    struct ThreadConfiguration {
+        // Pin the main thread and the workers to cores.
+        bool pin;
+
+        // Physical cores left to the rest of the system when pinning.
+        int reserved_cores;
+
+        // Nice value for the main thread and the workers.
+        int priority;
+
+        // Step the simulation on its own thread and render whichever generation is newest.
+        bool simulation_thread;
+    };
 }
 
 
 void run_startup_script(
     lua::VirtualMachine &L, size_t &flock_size, float &world_bound,
-    app::WindowConfiguration &window
+    app::WindowConfiguration &window, app::AlgorithmConfiguration &algorithm, app::MemoryConfiguration &memory,
+    app::ThreadConfiguration &threads, app::RenderConfiguration &render
 ) {
     L.add_basic_libraries();
 
     // Create config table for Lua customization.
     lua::Table app_config {L.table("flox")};
-    app_config.create(4, 0);
+    app_config.create(18, 0);
     app_config.push_integer("flock_size", static_cast<int>(flock_size));
     app_config.push_number("world_bound", world_bound);
     app_config.push_integer("width", window.width);
     app_config.push_integer("height", window.height);
+    app_config.push_string("algorithm", algorithm.backend.c_str());
+    app_config.push_integer("tiled_crossover", static_cast<int>(algorithm.tiled_crossover));
+    app_config.push_string("steering", algorithm.steering.c_str());
+    app_config.push_boolean("pipelined_tree", algorithm.pipelined_tree);
+    app_config.push_string("huge_pages", memory.huge_pages.c_str());
+    app_config.push_boolean("interleave", memory.interleave);
+    app_config.push_boolean("mapped_flock", memory.mapped_flock);
+    app_config.push_boolean("packed_instances", memory.packed_instances);
+    app_config.push_boolean("pin_threads", threads.pin);
+    app_config.push_integer("reserved_cores", threads.reserved_cores);
+    app_config.push_integer("thread_priority", threads.priority);
+    app_config.push_boolean("simulation_thread", threads.simulation_thread);
+    app_config.push_boolean("level_of_detail", render.level_of_detail);
+    app_config.push_string("shader_cache", render.shader_cache.c_str());
     L.push_global(app_config);
 
     const bool valid_lua = [](lua::VirtualMachine &L) {
-        lua::CodeFile custom_start {"Data/Scripts/flox.lua"};
-        int r = L.run(custom_start);
-        if (r == LUA_OK) {
-            return true;
-        }
+        int r;
+        const std::string_view script {Resources::get().load("Scripts/flox.lua")};
+        if (!script.empty()) {
+            lua::CodeBuffer custom_start {script.data(), script.size(), "@Scripts/flox.lua"};
+            r = L.run(custom_start);
+            if (r == LUA_OK) {
+                return true;
+            }
 
-        // Pop error message.
-        std::cout << "Error from external script file:\n    " << L.to_string() << std::endl;
+            // Pop error message.
+            std::cout << "Error from external script file:\n    " << L.to_string() << std::endl;
+        }
 
         lua::CodeBuffer default_start {(const char *) (FLOX_DEFAULT_LUA_SCRIPT), FLOX_DEFAULT_LUA_SCRIPT_LENGTH};
         r = L.run(default_start);
@@ -116,6 +197,20 @@ void run_startup_script(
         world_bound = app_config.to_number("world_bound", world_bound);
         window.width = app_config.to_integer("width", window.width);
         window.height = app_config.to_integer("height", window.height);
+        algorithm.backend = app_config.to_string("algorithm", algorithm.backend);
+        algorithm.tiled_crossover = app_config.to_integer("tiled_crossover", algorithm.tiled_crossover);
+        algorithm.steering = app_config.to_string("steering", algorithm.steering);
+        algorithm.pipelined_tree = app_config.to_boolean("pipelined_tree", algorithm.pipelined_tree);
+        memory.huge_pages = app_config.to_string("huge_pages", memory.huge_pages);
+        memory.interleave = app_config.to_boolean("interleave", memory.interleave);
+        memory.mapped_flock = app_config.to_boolean("mapped_flock", memory.mapped_flock);
+        memory.packed_instances = app_config.to_boolean("packed_instances", memory.packed_instances);
+        threads.pin = app_config.to_boolean("pin_threads", threads.pin);
+        threads.reserved_cores = app_config.to_integer("reserved_cores", threads.reserved_cores);
+        threads.priority = app_config.to_integer("thread_priority", threads.priority);
+        threads.simulation_thread = app_config.to_boolean("simulation_thread", threads.simulation_thread);
+        render.level_of_detail = app_config.to_boolean("level_of_detail", render.level_of_detail);
+        render.shader_cache = app_config.to_string("shader_cache", render.shader_cache);
         app_config.pop();
     }
 }
@@ -125,9 +220,39 @@ int run() {
     size_t flock_size = 1024;
     float world_bound = 500.0f;
     app::WindowConfiguration window_configuration {800, 450};
+    app::AlgorithmConfiguration algorithm_configuration {"auto", TiledAlgorithm::Crossover, "accurate", false};
+    app::MemoryConfiguration memory_configuration {"off", false, false, false};
+    app::ThreadConfiguration thread_configuration {false, 0, 0, false};
+    app::RenderConfiguration render_configuration {true, "Data/ShaderCache"};
+
+    // The startup script stays a loose file users can edit. Loose shaders and models are only copied out, and only
+    // honoured, when the build asks for them, so copies left by older builds cannot shadow the packed ones.
+    Resources::get().open(
+        "Data/resources.pack", "Data", {
+            "Scripts",
+#ifdef FLOX_LOOSE_RESOURCES
+            "Shaders", "Models"
+#endif
+        }
+    );
 
     auto &L {lua::VirtualMachine::get()};
-    run_startup_script(L, flock_size, world_bound, window_configuration);
+    run_startup_script(
+        L, flock_size, world_bound, window_configuration, algorithm_configuration, memory_configuration,
+        thread_configuration, render_configuration
+    );
+
+    if (algorithm_configuration.steering == "fast") {
+        steering_mode = SteeringMode::Fast;
+    } else if (algorithm_configuration.steering == "exact") {
+        steering_mode = SteeringMode::Exact;
+    } else {
+        steering_mode = SteeringMode::Accurate;
+    }
+
+#ifdef FLOX_STEERING_REPORT
+    steering_report(std::cout);
+#endif
     lua::Function lua_on_frame_start {L.function("OnFrameStart", 1, 0)};
 
     Window &window {Window::get()};
@@ -150,6 +275,7 @@ int run() {
     }(window.real_size());
 
     lwvl::Program::clear();
+    lwvl::ProgramCache::directory(render_configuration.shader_cache);
 #ifdef FLOX_SHOW_DEBUG_INFO
     GLEventListener listener(
         [](
@@ -174,6 +300,7 @@ int run() {
     bool debug_visual = false;
     bool render_boids = true;
     bool render_vision = false;
+    bool render_heatmap = false;
     bool render_quadtree_colored = false;
     bool render_quadtree_lines = false;
     bool render_debug_rectangles = false;
@@ -188,19 +315,41 @@ int run() {
     };
     const Rectangle bounding_box {bounds};
 
-    Flock flock {flock_size};
+    // One team of workers shared by the whole simulation. The main thread is the last participant, or the simulation
+    // thread when there is one, which then also takes over the main thread's pinned core.
+    WorkerTeam workers {
+        static_cast<int>(std::max(std::thread::hardware_concurrency(), 2u)) - 1,
+        ThreadPlacement {thread_configuration.pin, thread_configuration.reserved_cores, thread_configuration.priority}
+    };
+
+    AllocationPolicy allocation_policy;
+    allocation_policy.interleave = memory_configuration.interleave;
+    if (memory_configuration.huge_pages == "transparent") {
+        allocation_policy.huge_pages = HugePages::Transparent;
+    } else if (memory_configuration.huge_pages == "explicit") {
+        allocation_policy.huge_pages = HugePages::Explicit;
+    }
+
+    Flock flock {flock_size, workers, allocation_policy};
 
     // Unused algorithms are dead code, but having them as components allows easier testing.
     //DirectLoopAlgorithm direct_loop_algorithm{bounds};
     //QuadtreeAlgorithm quadtree_algorithm{bounds};
-    ThreadedAlgorithm threaded_algorithm {bounds};
+    ThreadedAlgorithm threaded_algorithm {bounds, workers, algorithm_configuration.pipelined_tree};
+    TiledAlgorithm tiled_algorithm {bounds, workers};
     //DirectComputeAlgorithm compute_algorithm {bounding_box};
     //structures::Quadtree<std::ptrdiff_t> quadtree {bounding_box};
 
+    // Small flocks are cheaper all-pairs than through a tree that is rebuilt every frame.
+    const bool use_tiled = algorithm_configuration.backend == "tiled" || (
+        algorithm_configuration.backend != "tree" && flock_size <= algorithm_configuration.tiled_crossover
+    );
+
     //Algorithm* algorithm = &direct_loop_algorithm;
     //QuadtreeAlgorithm *qt_algorithm = &quadtree_algorithm;
-    ThreadedAlgorithm *qt_algorithm = &threaded_algorithm;
-    Algorithm *algorithm = &threaded_algorithm;
+    // The tiled backend builds no tree, so there is no tree to draw.
+    ThreadedAlgorithm *qt_algorithm = use_tiled ? nullptr : &threaded_algorithm;
+    Algorithm *algorithm = use_tiled ? static_cast<Algorithm *>(&tiled_algorithm) : &threaded_algorithm;
     //Algorithm *algorithm = &compute_algorithm;
 
     Projection projection {
@@ -217,9 +366,19 @@ int run() {
     //Camera &active_camera {camera};
     Camera &active_camera {static_camera};
 
-    FlockRenderer renderer {flock_size};
-    QuadtreeRenderer quadtree_renderer {projection};
-    RectangleRenderer rectangle_renderer {projection, 2};
+    // Mapped storage is fenced on the GL thread, so it is only used when the flock is stepped there as well.
+    FlockRenderer renderer {flock_size, memory_configuration.mapped_flock && !thread_configuration.simulation_thread};
+    // Packed positions get twice the world's extent, so boids wandering off the edge are still drawn where they are.
+    const Rectangle packing_box {bounding_box.center, bounding_box.size * 2.0f};
+    if (renderer.mapped()) {
+        flock.adopt(renderer);
+    } else if (memory_configuration.packed_instances) {
+        renderer.pack(packing_box);
+    }
+    FrameUniforms frame_uniforms {projection};
+    QuadtreeRenderer quadtree_renderer;
+    HeatmapRenderer heatmap_renderer {width, height};
+    RectangleRenderer rectangle_renderer {2};
 
     rectangle_renderer.push(bounding_box);
     auto camera_rectangle_link = rectangle_renderer.push(bounding_box, Color {0.94118f, 0.63529f, 0.00784f, 1.0f});
@@ -248,16 +407,33 @@ int run() {
         ), flock_size
     };
 
+    Model point_model {
+        loadObject(
+            pointShape.data(), pointShape.size(),
+            pointIndices.data(), pointIndices.size(),
+            lwvl::PrimitiveMode::Points
+        ), flock_size
+    };
+
     Model *active_model = &filled_model;
 
     renderer.attachData(&classic_model);
     renderer.attachData(&filled_model);
     renderer.attachData(&vision_model);
+    renderer.attachData(&point_model);
 
-    DefaultBoidShader default_boid_shader {projection};
-    SpeedDebugShader speed_debug_shader {projection};
-    VisionShader vision_shader {projection};
+    DefaultBoidShader default_boid_shader;
+    DefaultBoidShader sprite_boid_shader {"Shaders/boidsprite.frag"};
+    SpeedDebugShader speed_debug_shader;
+    VisionShader vision_shader {Boid::cohesiveRadius, Boid::disruptiveRadius};
     BoidShader *active_shader = &default_boid_shader;
+    if (renderer.packed()) {
+        default_boid_shader.unpack_from(packing_box);
+        sprite_boid_shader.unpack_from(packing_box);
+        speed_debug_shader.unpack_from(packing_box);
+        vision_shader.unpack_from(packing_box);
+        heatmap_renderer.unpack_from(packing_box);
+    }
 
 #ifdef FLOX_SHOW_DEBUG_INFO
     std::cout << "Setup took " << delta(setup_start) << " seconds." << std::endl;
@@ -265,13 +441,6 @@ int run() {
 #endif
     auto frame_start = high_resolution_clock::now();
 
-#ifdef FLOX_SHOW_DEBUG_INFO
-    double event_duration_average = 0.0;
-    double update_duration_average = 0.0;
-    double render_update_duration_average = 0.0;
-    double render_duration_average = 0.0;
-#endif
-
     //L.pushNumber(1.0 / 60.0);
     //L.setGlobal("fps");
 
@@ -284,273 +453,395 @@ int run() {
 #endif
 
     glEnable(GL_BLEND);
+    glEnable(GL_PROGRAM_POINT_SIZE);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    for (int frame_count = 1; !window.should_close(); frame_count++) {
-        // Calculate the time since last frame
-        const auto dt = static_cast<float>(delta(frame_start));
-        frame_start = high_resolution_clock::now();
 
-#ifdef FLOX_DEBUG_TIMINGS
-        if (total_frame_count >= 1800) {
-            window.should_close(true);
-            continue;
-        }
-#endif
+    // Frame stages, declared once and run every frame. Only culling and quadtree geometry leave the main thread. They
+    // run side by side, and the tree is built while the boids upload.
+    float dt = 0.0f;
+    const auto quadtree_visible = [&]() {
+        return qt_algorithm && (render_quadtree_colored || render_quadtree_lines);
+    };
 
+    // Pixels one world unit covers at the current zoom.
+    const auto pixels_per_unit = [&]() {
+        return static_cast<float>(width) / (2.0f * bounds.x) * static_camera.zoom();
+    };
 
-        if (lua_on_frame_start.push()) {
-            L.push_number(dt);
-            //L.validate(onFrameStart.call());
-            L.log(lua_on_frame_start.call());
-            // Nothing left on stack after call.
-        }
+    const auto vision_visible = [&]() {
+        return render_vision && !render_heatmap && (
+            !render_configuration.level_of_detail || Boid::cohesiveRadius * pixels_per_unit() >= VisionCutoffPixels
+        );
+    };
 
-#ifdef FLOX_SHOW_DEBUG_INFO
-        auto average_start = high_resolution_clock::now();
-#endif
+    // With a simulation thread, the frame renders whatever generation it last finished instead of stepping itself.
+    std::optional<SimulationThread> simulation;
+    Generation const *generation = nullptr;
+    if (thread_configuration.simulation_thread) {
+        simulation.emplace(flock, algorithm, qt_algorithm, workers);
+    }
 
-        // Fill event stack
-        window.update();
+    TaskGraph frame;
+    frame.add(
+        "lua", Affinity::Main, [&]() {
+            if (lua_on_frame_start.push()) {
+                L.push_number(dt);
+                //L.validate(onFrameStart.call());
+                L.log(lua_on_frame_start.call());
+                // Nothing left on stack after call.
+            }
+        }
+    );
 
-        // Handle incoming events
-        while (std::optional<Event> possible = window.poll_event()) {
-            // This is where we need an event system with the ability to consume events
-            // bool handle_event(...) { return true; }
+    const auto events_stage = frame.add(
+        "events", Affinity::Main, [&]() {
+            // Fill event stack
+            window.update();
 
-            if (!possible.has_value()) {
-                continue;
-            }
+            // Handle incoming events
+            while (std::optional<Event> possible = window.poll_event()) {
+                // This is where we need an event system with the ability to consume events
+                // bool handle_event(...) { return true; }
 
-            Event &concrete = possible.value();
-            switch (concrete.type) {
-                using
-                enum Event::Type;
-                case Scroll:
-                    [&](const ScrollEvent &event) {
-                        constexpr float zoom_multiplier = 0.5f;
-                        const float current_zoom {active_camera.zoom()};
-                        const auto offset = static_cast<float>(event.y_offset) * zoom_multiplier;
-                        float new_zoom = current_zoom;
-
-                        // Figure out a good multiplier for scroll zoom.
-                        if (current_zoom + offset < 1.0f) {
-                            new_zoom = 1.0f;
-                        } else if (current_zoom + offset > 25.0f) {
-                            new_zoom = 25.0f;
-                        } else {
-                            new_zoom += offset;
-                        }
-
-                        if (new_zoom == current_zoom) {
-                            return;
-                        }
-
-                        active_camera.zoom(new_zoom);
-                        camera_rectangle_link.get().rectangle = active_camera.box();
-                    }(std::get<ScrollEvent>(concrete.event));
+                if (!possible.has_value()) {
                     continue;
-                case KeyPress:
-                case KeyRelease:
-                    [&](const KeyboardEvent &event, const Event::Type type) {
-                        if (type != KeyRelease) {
-                            return;
-                        }
-
-                        //if (event.mods & GLFW_MOD_SHIFT && event.key == GLFW_KEY_ESCAPE) {
-                        if (event.key == GLFW_KEY_ESCAPE) {
-                            window.should_close(true);
-                            return;
-                        }
-
-                        if (event.key == GLFW_KEY_GRAVE_ACCENT) {
-                            console_open ^= true;
-                            return;
-                        }
-
-                        if (console_open) {
-                            return;
-                        }
-
-                        switch (event.key) {
-                            case GLFW_KEY_SPACE:paused ^= true;
+                }
+
+                Event &concrete = possible.value();
+                switch (concrete.type) {
+                    using
+                    enum Event::Type;
+                    case Scroll:
+                        [&](const ScrollEvent &event) {
+                            constexpr float zoom_multiplier = 0.5f;
+                            const float current_zoom {active_camera.zoom()};
+                            const auto offset = static_cast<float>(event.y_offset) * zoom_multiplier;
+                            float new_zoom = current_zoom;
+
+                            // Figure out a good multiplier for scroll zoom.
+                            if (current_zoom + offset < 1.0f) {
+                                new_zoom = 1.0f;
+                            } else if (current_zoom + offset > 25.0f) {
+                                new_zoom = 25.0f;
+                            } else {
+                                new_zoom += offset;
+                            }
+
+                            if (new_zoom == current_zoom) {
                                 return;
-                            case GLFW_KEY_1:
-                                if (active_model == &filled_model && active_shader == &default_boid_shader) {
-                                    default_boid_shader.nextColor();
-                                } else {
-                                    active_model = &filled_model;
-                                }
+                            }
+
+                            active_camera.zoom(new_zoom);
+                            camera_rectangle_link.get().rectangle = active_camera.box();
+                        }(std::get<ScrollEvent>(concrete.event));
+                        continue;
+                    case KeyPress:
+                    case KeyRelease:
+                        [&](const KeyboardEvent &event, const Event::Type type) {
+                            if (type != KeyRelease) {
                                 return;
-                            case GLFW_KEY_2:
-                                if (active_model == &classic_model && active_shader == &default_boid_shader) {
-                                    default_boid_shader.nextColor();
-                                } else {
-                                    active_model = &classic_model;
-                                }
+                            }
+
+                            //if (event.mods & GLFW_MOD_SHIFT && event.key == GLFW_KEY_ESCAPE) {
+                            if (event.key == GLFW_KEY_ESCAPE) {
+                                window.should_close(true);
                                 return;
-                            case GLFW_KEY_B:render_boids ^= true;
+                            }
+
+                            if (event.key == GLFW_KEY_GRAVE_ACCENT) {
+                                console_open ^= true;
                                 return;
-                            case GLFW_KEY_V:render_vision ^= true;
+                            }
+
+                            if (console_open) {
                                 return;
-                            case GLFW_KEY_Q:render_quadtree_lines ^= true;
+                            }
+
+                            switch (event.key) {
+                                case GLFW_KEY_SPACE:paused ^= true;
+                                    return;
+                                case GLFW_KEY_1:
+                                    if (active_model == &filled_model && active_shader == &default_boid_shader) {
+                                        default_boid_shader.nextColor();
+                                        sprite_boid_shader.nextColor();
+                                    } else {
+                                        active_model = &filled_model;
+                                    }
+                                    return;
+                                case GLFW_KEY_2:
+                                    if (active_model == &classic_model && active_shader == &default_boid_shader) {
+                                        default_boid_shader.nextColor();
+                                        sprite_boid_shader.nextColor();
+                                    } else {
+                                        active_model = &classic_model;
+                                    }
+                                    return;
+                                case GLFW_KEY_B:render_boids ^= true;
+                                    return;
+                                case GLFW_KEY_V:render_vision ^= true;
+                                    return;
+                                case GLFW_KEY_H:render_heatmap ^= true;
+                                    return;
+                                case GLFW_KEY_Q:
+                                case GLFW_KEY_C:
+                                    // The tiled backend builds no tree to show.
+                                    if (!qt_algorithm) {
+                                        std::cout << "The quadtree views need flox.algorithm = \"tree\"." << std::endl;
+                                        return;
+                                    }
+
+                                    if (event.key == GLFW_KEY_Q) {
+                                        render_quadtree_lines ^= true;
+                                    } else {
+                                        render_quadtree_colored ^= true;
+                                    }
+                                    return;
+                                case GLFW_KEY_S:debug_visual ^= true;
+                                    if (debug_visual) {
+                                        active_shader = &speed_debug_shader;
+                                    } else {
+                                        active_shader = &default_boid_shader;
+                                    }
+                                    return;
+                                default:return;
+                            }
+                        }(std::get<KeyboardEvent>(concrete.event), concrete.type);
+                        continue;
+                    case MouseDown:
+                    case MouseUp:
+                        [&](const MouseButtonEvent &event, const Event::Type type) {
+                            if (event.button == GLFW_MOUSE_BUTTON_1 && type == MouseDown) {
+                                mouse_1_pressed = true;
                                 return;
-                            case GLFW_KEY_C:render_quadtree_colored ^= true;
+                            }
+
+                            if (event.button == GLFW_MOUSE_BUTTON_1 && type == MouseUp) {
+                                mouse_1_pressed = false;
                                 return;
-                            case GLFW_KEY_S:debug_visual ^= true;
-                                if (debug_visual) {
-                                    active_shader = &speed_debug_shader;
-                                } else {
-                                    active_shader = &default_boid_shader;
-                                }
+                            }
+                        }(std::get<MouseButtonEvent>(concrete.event), concrete.type);
+                        continue;
+                    case MouseMotion:
+                        [&](const MouseMotionEvent &event) {
+                            const Vector cursor_previous_position = cursor_position;
+                            {
+                                const auto x_pos = static_cast<float>(event.x_pos) / static_cast<float>(width);
+                                const auto y_pos = 1.0f - (static_cast<float>(event.y_pos) / static_cast<float>(height));
+                                cursor_position = Vector {
+                                    (x_pos * 2.0f - 1.0f) * bounds.x,
+                                    (y_pos * 2.0f - 1.0f) * bounds.y
+                                };
+                            }
+
+                            if (!mouse_1_pressed) {
                                 return;
-                            default:return;
-                        }
-                    }(std::get<KeyboardEvent>(concrete.event), concrete.type);
-                    continue;
-                case MouseDown:
-                case MouseUp:
-                    [&](const MouseButtonEvent &event, const Event::Type type) {
-                        if (event.button == GLFW_MOUSE_BUTTON_1 && type == MouseDown) {
-                            mouse_1_pressed = true;
-                            return;
-                        }
-
-                        if (event.button == GLFW_MOUSE_BUTTON_1 && type == MouseUp) {
-                            mouse_1_pressed = false;
-                            return;
-                        }
-                    }(std::get<MouseButtonEvent>(concrete.event), concrete.type);
-                    continue;
-                case MouseMotion:
-                    [&](const MouseMotionEvent &event) {
-                        const Vector cursor_previous_position = cursor_position;
-                        {
-                            const auto x_pos = static_cast<float>(event.x_pos) / static_cast<float>(width);
-                            const auto y_pos = 1.0f - (static_cast<float>(event.y_pos) / static_cast<float>(height));
-                            cursor_position = Vector {
-                                (x_pos * 2.0f - 1.0f) * bounds.x,
-                                (y_pos * 2.0f - 1.0f) * bounds.y
-                            };
-                        }
-
-                        if (!mouse_1_pressed) {
-                            return;
-                        }
-
-                        const Vector cursor_delta {cursor_position - cursor_previous_position};
-
-                        // Can't move left if the left edge of the camera would extend too far off the space.
-                        // bounds / zoom level is acceptable camera space?
-                        // Extra: Camera is context-aware. Quadtree can grow the allowed camera space.
-
-                        const Vector slowdown {1.0f / (glm::log(active_camera.zoom_vector()) * 3.0f + 1.0f + Epsilon)};
-                        const Vector camera_delta {-cursor_delta * slowdown};
-
-                        active_camera.move(camera_delta);
-                        camera_rectangle_link.get().rectangle = active_camera.box();
-                    }(std::get<MouseMotionEvent>(concrete.event));
-                    continue;
-                case KeyRepeat:
-                case TextInput:continue;
+                            }
+
+                            const Vector cursor_delta {cursor_position - cursor_previous_position};
+
+                            // Can't move left if the left edge of the camera would extend too far off the space.
+                            // bounds / zoom level is acceptable camera space?
+                            // Extra: Camera is context-aware. Quadtree can grow the allowed camera space.
+
+                            const Vector slowdown {1.0f / (glm::log(active_camera.zoom_vector()) * 3.0f + 1.0f + Epsilon)};
+                            const Vector camera_delta {-cursor_delta * slowdown};
+
+                            active_camera.move(camera_delta);
+                            camera_rectangle_link.get().rectangle = active_camera.box();
+                        }(std::get<MouseMotionEvent>(concrete.event));
+                        continue;
+                    case KeyRepeat:
+                    case TextInput:continue;
+                }
             }
         }
+    );
 
-#ifdef FLOX_SHOW_DEBUG_INFO
-        event_duration_average += delta(average_start);
-        average_start = high_resolution_clock::now();
-#else
-#ifdef FLOX_DEBUG_TIMINGS
-        auto averageStart = high_resolution_clock::now();
-#endif
-#endif
+    const auto simulate_stage = frame.add(
+        "simulate", Affinity::Main, [&]() {
+            if (simulation) {
+                simulation->paused(paused || console_open);
+                simulation->capture_quadtree(quadtree_visible());
+                generation = simulation->latest();
+            } else if (!paused && !console_open) {
+                flock.update(algorithm, dt);
+            }
+        }, {events_stage}
+    );
 
-        // Update engine
-        bool do_updates = !paused && !console_open;
-        if (do_updates) {
-            flock.update(algorithm, dt);
-        }
+    // Only what the camera can see is uploaded and drawn. Mapped boids are drawn in place, so there is nothing to cull.
+    FlockCuller culler;
+    bool culled = false;
+    const auto cull_stage = frame.add(
+        "cull boids", Affinity::Any, [&]() {
+            culled = false;
+            if (renderer.mapped() || !(render_boids || render_heatmap || vision_visible())) {
+                return;
+            }
 
-        //if (render_quadtree_colored || render_quadtree_lines) {
-        //    const auto qt_flock_count_temp {static_cast<std::ptrdiff_t>(flock.count())};
-        //    const Boid* qt_flock_read_temp {flock.boids()};
-        //    for (std::ptrdiff_t i = 0; i < qt_flock_count_temp; ++i) {
-        //        quadtree.insert(i, qt_flock_read_temp[i].position);
-        //    }
-        //}
+            const float reach = vision_visible() ? std::max(Boid::cohesiveRadius, Boid::disruptiveRadius) : Boid::scale;
+            if (!simulation) {
+                // The tree is not ours to read while a simulation thread runs.
+                FlockCuller::Tree tree;
+                if (qt_algorithm) {
+                    tree = {&qt_algorithm->tree(), qt_algorithm->tree_source(), Boid::maxSpeed * dt};
+                }
+                culled = culler.cull(flock.boids(), flock.count(), static_camera.box(), reach, tree);
+            } else if (generation) {
+                culled = culler.cull(
+                    generation->boids.data(), generation->boids.size(), static_camera.box(), reach
+                );
+            }
+        }, {simulate_stage}
+    );
 
-#ifdef FLOX_DEBUG_TIMINGS
-        auto update_delta = duration_cast<microseconds>(
-            high_resolution_clock::now() - average_start
-        ).count();
-        if (total_frame_count > 1199) {
-            if (total_frame_count == 1200) {
-                std::cout << "Started timing capture." << std::endl;
-                file << update_delta;
+    const auto boids_stage = frame.add(
+        "upload boids", Affinity::Main, [&]() {
+            if (!(render_boids || render_heatmap || vision_visible())) {
+                return;
+            }
+
+            Boid const *boids = nullptr;
+            if (!simulation) {
+                boids = flock.boids();
+            } else if (generation) {
+                boids = generation->boids.data();
+            }
+
+            if (boids && culled) {
+                renderer.update(boids, culler.visible());
+            } else if (boids) {
+                renderer.update(boids);
+            }
+        }, {cull_stage}
+    );
+
+    const auto quadtree_build_stage = frame.add(
+        "build quadtree", Affinity::Any, [&]() {
+            // The simulation thread builds its own, the tree is not ours to read while it runs.
+            if (!simulation && quadtree_visible()) {
+                quadtree_renderer.build(qt_algorithm->tree());
+            }
+        }, {simulate_stage}
+    );
+
+    const auto quadtree_upload_stage = frame.add(
+        "upload quadtree", Affinity::Main, [&]() {
+            if (!quadtree_visible()) {
+                return;
+            }
+
+            if (!simulation) {
+                quadtree_renderer.upload();
+            } else if (generation) {
+                quadtree_renderer.upload(generation->quadtree.data(), generation->quadtree.size());
+            }
+        }, {quadtree_build_stage}
+    );
+
+    const auto rectangles_stage = frame.add(
+        "upload rectangles", Affinity::Main, [&]() {
+            if (render_debug_rectangles) {
+                rectangle_renderer.update();
+            }
+        }, {events_stage}
+    );
+
+    frame.add(
+        "draw", Affinity::Main, [&]() {
+            if (!render_quadtree_colored) {
+                glClearColor(clear_color.r, clear_color.g, clear_color.b, clear_color.a);
             } else {
-                file << ',' << update_delta;
+                glClearColor(0.43137f, 0.64314f, 0.74902f, 1.0f);
             }
-        }
-        ++total_frame_count;
-#endif
-#ifdef FLOX_SHOW_DEBUG_INFO
-        update_duration_average += delta(average_start);
-        average_start = high_resolution_clock::now();
-#endif
+            lwvl::clear();
 
-        // Rendering
-        if (render_boids || render_vision) {
-            renderer.update(flock.boids());
-        }
+            // Camera and frame constants for every program, bound once.
+            frame_uniforms.update(static_camera, dt);
 
-        if (render_quadtree_colored || render_quadtree_lines) {
-            quadtree_renderer.update(qt_algorithm->tree());
-            //quadtree_renderer.update(quadtree);
-            //quadtree.clear();
-        }
+            if (quadtree_visible()) {
+                quadtree_renderer.draw(render_quadtree_colored, render_quadtree_lines);
+            }
 
-        if (render_debug_rectangles) {
-            rectangle_renderer.update();
-        }
+            if (vision_visible()) {
+                vision_shader.draw(&vision_model);
+            }
+
+            // The heatmap stands in for the boids and their vision.
+            if (render_heatmap) {
+                heatmap_renderer.draw(&point_model, renderer.instances(), debug_visual);
+            } else if (render_boids) {
+                const float radius_pixels = Boid::scale * pixels_per_unit();
+                const BoidDetail detail {
+                    render_configuration.level_of_detail ? boid_detail(radius_pixels) : BoidDetail::Mesh
+                };
+
+                if (detail == BoidDetail::Mesh) {
+                    FlockRenderer::draw(active_model, active_shader);
+                } else {
+                    // Sprites take the arrow's shape unless every boid is colored by speed anyway.
+                    BoidShader *shader = active_shader;
+                    float point_size = 1.0f;
+                    if (detail == BoidDetail::Sprite) {
+                        shader = debug_visual ? active_shader : &sprite_boid_shader;
+                        point_size = 2.0f * radius_pixels;
+                    }
+
+                    shader->point_size(point_size);
+                    FlockRenderer::draw(&point_model, shader);
+                }
+            }
+
+            if (render_debug_rectangles) {
+                rectangle_renderer.draw();
+            }
+
+            renderer.fence();
+            frame_uniforms.fence();
+            window.swap_buffers();
+        }, {boids_stage, quadtree_upload_stage, rectangles_stage}
+    );
 
 #ifdef FLOX_SHOW_DEBUG_INFO
-        render_update_duration_average += delta(average_start);
-        average_start = high_resolution_clock::now();
+    std::vector<double> stage_duration_averages(frame.size(), 0.0);
 #endif
 
-        if (!render_quadtree_colored) {
-            glClearColor(clear_color.r, clear_color.g, clear_color.b, clear_color.a);
-        } else {
-            glClearColor(0.43137f, 0.64314f, 0.74902f, 1.0f);
-        }
-        lwvl::clear();
+    for (int frame_count = 1; !window.should_close(); frame_count++) {
+        // Calculate the time since last frame
+        dt = static_cast<float>(delta(frame_start));
+        frame_start = high_resolution_clock::now();
 
-        if (render_quadtree_colored || render_quadtree_lines) {
-            quadtree_renderer.update_camera(static_camera);
-            quadtree_renderer.draw(render_quadtree_colored, render_quadtree_lines);
+        // Everything handed out by the frame arenas last frame is released here. The team is idle between frames.
+        // A simulation thread keeps that clock itself.
+        if (!simulation) {
+            FrameArena::next_frame();
         }
 
-        if (render_vision) {
-            vision_shader.update_camera(static_camera);
-            vision_shader.radius(Boid::cohesiveRadius);
-            FlockRenderer::draw(&vision_model, &vision_shader);
-            vision_shader.radius(Boid::disruptiveRadius);
-            FlockRenderer::draw(&vision_model, &vision_shader);
+#ifdef FLOX_DEBUG_TIMINGS
+        if (total_frame_count >= 1800) {
+            window.should_close(true);
+            continue;
         }
+#endif
 
-        if (render_boids) {
-            active_shader->update_camera(static_camera);
-            FlockRenderer::draw(active_model, active_shader);
-        }
+        frame.run();
 
-        if (render_debug_rectangles) {
-            rectangle_renderer.update_camera(static_camera);
-            rectangle_renderer.draw();
+#ifdef FLOX_DEBUG_TIMINGS
+        auto update_delta = static_cast<long long>(frame.timing(simulate_stage).duration * 1e6);
+        if (total_frame_count > 1199) {
+            if (total_frame_count == 1200) {
+                std::cout << "Started timing capture." << std::endl;
+                file << update_delta;
+            } else {
+                file << ',' << update_delta;
+            }
         }
-
-        window.swap_buffers();
-
+        ++total_frame_count;
+#endif
 #ifdef FLOX_SHOW_DEBUG_INFO
-        render_duration_average += delta(average_start);
+        for (TaskGraph::Task stage = 0; stage < frame.size(); ++stage) {
+            stage_duration_averages[stage] += frame.timing(stage).duration;
+        }
 #endif
 
         if (delta(frame_start) <= 0.008) {
@@ -565,22 +856,26 @@ int run() {
             const auto frameth = 1.0 / static_cast<double>(frame_count);
             std::cout << "Average framerate for last " << frame_count << " frames: " << fps << " | " << 1.0 / fps << 's'
                       << '\n';
-            std::cout << "Event updates: " << event_duration_average * frameth << "s, ";
-            std::cout << "Flock updates: " << update_duration_average * frameth << "s, ";
-            std::cout << "Rendering Updates: " << render_update_duration_average * frameth << "s, ";
-            std::cout << "Rendering: " << render_duration_average * frameth << 's' << '\n';
+            for (TaskGraph::Task stage = 0; stage < frame.size(); ++stage) {
+                std::cout << frame.name(stage) << ": " << stage_duration_averages[stage] * frameth << "s, ";
+                stage_duration_averages[stage] = 0.0;
+            }
+            std::cout << '\n';
+            frame.report(std::cout);
             std::cout << '\n';
-
-            // Reset time variables.
-            event_duration_average = 0.0;
-            update_duration_average = 0.0;
-            render_update_duration_average = 0.0;
-            render_duration_average = 0.0;
 #endif
             frame_count = 0;
         }
     }
 
+#ifdef FLOX_SHOW_DEBUG_INFO
+    // The last frame's graph, for a closer look with Graphviz.
+    {
+        std::ofstream graph_file {"UltimateFlox - Frame Graph.dot"};
+        frame.write_dot(graph_file);
+    }
+#endif
+
     lua::Function lua_on_exit {L.function("OnExit", 0, 0)};
     if (lua_on_exit.push()) {
         L.log(lua_on_exit.call());
@@ -48,8 +48,8 @@ int lua::CodeFile::run(lua_State *L) {
     return luaL_dofile(L, filename.c_str());
 }
 
-lua::CodeBuffer::CodeBuffer(const char* b, std::size_t s): buffer(b), size(s) {}
+lua::CodeBuffer::CodeBuffer(const char* b, std::size_t s, const char* n): buffer(b), size(s), name(n) {}
 
 int lua::CodeBuffer::run(lua_State *L) {
-    return luaL_loadbufferx(L, (const char*)buffer, size, "", nullptr) || lua_pcall(L, 0, LUA_MULTRET, 0);
+    return luaL_loadbufferx(L, (const char*)buffer, size, name, nullptr) || lua_pcall(L, 0, LUA_MULTRET, 0);
 }
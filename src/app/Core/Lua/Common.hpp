@@ -39,10 +39,11 @@ namespace lua {
 
     // Can add a concept-base to control whether this manages the buffer.
     struct CodeBuffer {
-        CodeBuffer(const char*, std::size_t);
+        CodeBuffer(const char*, std::size_t, const char* name = "");
         int run(lua_State*);
 
         const char* buffer;
         std::size_t size; // Length and size are synonyms when used with an array of bytes.
+        const char* name; // Chunk name for error messages, "@path" to have them read like a file's.
     };
 }
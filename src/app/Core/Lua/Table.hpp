@@ -46,6 +46,7 @@ namespace lua {
         void push_integer(const char *key, lua_Integer value);
         void push_number(const char *key, lua_Number value);
         void push_string(const char *key, const char* value);
+        void push_boolean(const char *key, bool value);
 
         [[nodiscard]] lua_Integer to_integer(const char *key, int* isNum = nullptr);
         [[nodiscard]] lua_Number to_number(const char *key, int* isNum = nullptr);
@@ -62,6 +63,7 @@ namespace lua {
         }
 
         [[nodiscard]] std::string to_string(const char *key, std::string const& backup);
+        [[nodiscard]] bool to_boolean(const char *key, bool backup);
 
         [[nodiscard]] std::string const& name() const;
 
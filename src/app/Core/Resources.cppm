@@ -0,0 +1,215 @@
+module;
+#include "pch.hpp"
+export module Resources;
+
+// Shaders, scripts and models, served from one archive the build packs them into.
+// . The archive is opened once and mapped, so every resource is a view into it and nothing is copied or read again.
+// . A loose file in one of the override directories with the same name wins over the archive, so a shader can be
+//   edited and picked up by the next run without repacking. Only directories named to open() are looked at, so stale
+//   copies elsewhere in the build tree cannot shadow the packed files. They are listed once when the archive is
+//   opened, only overrides that are there get opened, and each one that replaces a packed file is reported.
+// . The archive starts with a text index, "FLOXPACK 1" and then one "<offset> <size> <name>" line per resource,
+//   closed by an empty line. Offsets count from the end of the index. res/PackResources.cmake writes it.
+
+
+constexpr std::string_view ArchiveMagic = "FLOXPACK 1";
+
+// The next line of text starting at position, without its line break, moving position past it.
+std::string_view next_line(std::string_view text, size_t &position) {
+    const size_t end = std::min(text.find('\n', position), text.size());
+    std::string_view line = text.substr(position, end - position);
+    position = end + 1;
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    return line;
+}
+
+bool parse_size(std::string_view &line, size_t &value) {
+    const auto [end, error] = std::from_chars(line.data(), line.data() + line.size(), value);
+    if (error != std::errc() || end == line.data() + line.size() || *end != ' ') {
+        return false;
+    }
+    line.remove_prefix(end - line.data() + 1);
+    return true;
+}
+
+
+export class Resources {
+    Resources() = default;
+
+public:
+    Resources(Resources const &) = delete;
+    Resources &operator=(Resources const &) = delete;
+
+    ~Resources() {
+        close();
+    }
+
+    static Resources &get() {
+        static Resources instance;
+        return instance;
+    }
+
+    // directories are the ones under overrides that may hold loose files, such as "Scripts".
+    // Views from before are gone once this is called again.
+    void open(
+        std::string const &archive, std::string overrides, std::initializer_list<std::string_view> directories
+    ) {
+        close();
+        if (map(archive) && !index()) {
+            std::cout << "Ignoring malformed resource archive " << archive << std::endl;
+            close();
+        }
+
+        m_overrides = std::move(overrides);
+        for (const std::string_view directory: directories) {
+            list_overrides(directory);
+        }
+    }
+
+    // Contents of a resource such as "Shaders/boid.vert", valid until the next open(). Empty when there is none.
+    std::string_view load(std::string_view name) {
+        if (const auto loose = m_loose.find(name); loose != m_loose.end()) {
+            return loose->second;
+        }
+
+        if (m_overridden.contains(name)) {
+            std::ifstream file {std::filesystem::path(m_overrides) / name, std::ios::binary};
+            std::string contents {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+            return m_loose.emplace(std::string(name), std::move(contents)).first->second;
+        }
+
+        if (const auto entry = m_entries.find(name); entry != m_entries.end()) {
+            return entry->second;
+        }
+
+        std::cout << "Missing resource " << name << std::endl;
+        return {};
+    }
+
+private:
+    void list_overrides(const std::string_view directory) {
+        if (m_overrides.empty()) {
+            return;
+        }
+
+        std::error_code error;
+        const std::filesystem::path root {m_overrides};
+        for (
+            auto file = std::filesystem::recursive_directory_iterator(root / directory, error);
+            !error && file != std::filesystem::recursive_directory_iterator();
+            file.increment(error)
+        ) {
+            if (file->is_regular_file(error)) {
+                std::string name = file->path().lexically_relative(root).generic_string();
+                if (m_entries.contains(name)) {
+                    std::cout << "Using loose " << file->path().generic_string() << " over the packed file" << std::endl;
+                }
+                m_overridden.insert(std::move(name));
+            }
+        }
+    }
+
+    bool map(std::string const &path) {
+#ifdef __linux__
+        const int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0) {
+            return false;
+        }
+
+        struct stat status {};
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+            void *data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, descriptor, 0);
+            if (data != MAP_FAILED) {
+                m_mapping = data;
+                m_archive = {static_cast<const char *>(data), static_cast<size_t>(status.st_size)};
+            }
+        }
+
+        // The mapping holds its own reference to the file.
+        ::close(descriptor);
+#else
+        std::ifstream file {path, std::ios::binary};
+        m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        m_archive = m_buffer;
+#endif
+        return !m_archive.empty();
+    }
+
+    bool index() {
+        size_t position = 0;
+        if (next_line(m_archive, position) != ArchiveMagic) {
+            return false;
+        }
+
+        struct Entry {
+            size_t offset, size;
+            std::string_view name;
+        };
+        std::vector<Entry> entries;
+        while (position < m_archive.size()) {
+            std::string_view line = next_line(m_archive, position);
+            if (line.empty()) {
+                break;
+            }
+
+            Entry entry {};
+            if (!parse_size(line, entry.offset) || !parse_size(line, entry.size) || line.empty()) {
+                return false;
+            }
+            entry.name = line;
+            entries.push_back(entry);
+        }
+
+        const std::string_view data = m_archive.substr(std::min(position, m_archive.size()));
+        for (Entry const &entry: entries) {
+            if (entry.offset > data.size() || entry.size > data.size() - entry.offset) {
+                return false;
+            }
+            m_entries.emplace(std::string(entry.name), data.substr(entry.offset, entry.size));
+        }
+        return true;
+    }
+
+    void close() {
+        m_entries.clear();
+        m_loose.clear();
+        m_overridden.clear();
+#ifdef __linux__
+        if (m_mapping) {
+            munmap(m_mapping, m_archive.size());
+            m_mapping = nullptr;
+        }
+#else
+        m_buffer.clear();
+#endif
+        m_archive = {};
+    }
+
+    // Lets lookups take a string_view without building a string first.
+    struct NameHash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view name) const {
+            return std::hash<std::string_view> {}(name);
+        }
+    };
+
+    template<class T>
+    using NameMap = std::unordered_map<std::string, T, NameHash, std::equal_to<>>;
+
+    std::string_view m_archive;
+#ifdef __linux__
+    void *m_mapping = nullptr;
+#else
+    std::string m_buffer;
+#endif
+    NameMap<std::string_view> m_entries;
+
+    std::unordered_set<std::string, NameHash, std::equal_to<>> m_overridden;
+
+    // Overrides that were read, kept so their views last as long as the archive's.
+    NameMap<std::string> m_loose;
+    std::string m_overrides;
+};
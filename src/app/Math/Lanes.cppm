@@ -0,0 +1,110 @@
+module;
+#include "pch.hpp"
+export module Lanes;
+
+// Thin wrapper over the widest float vector the build targets.
+// . AVX: 8 lanes. SSE2 (every x86-64): 4 lanes. Anything else: 1 lane of plain float.
+// . Masks come out of the comparisons and go into when(). Their representation is private to each width.
+// . Loads and stores are unaligned. Callers pad their arrays to a multiple of LaneCount.
+
+#if defined(__AVX__)
+export constexpr size_t LaneCount = 8;
+using NativeLanes = __m256;
+#elif defined(__SSE2__) || defined(_M_X64)
+export constexpr size_t LaneCount = 4;
+using NativeLanes = __m128;
+#else
+export constexpr size_t LaneCount = 1;
+using NativeLanes = float;
+#endif
+
+
+export struct Lanes {
+    NativeLanes v;
+
+#if defined(__AVX__)
+    static Lanes load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    static Lanes broadcast(const float f) { return {_mm256_set1_ps(f)}; }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    friend Lanes operator+(const Lanes a, const Lanes b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend Lanes operator-(const Lanes a, const Lanes b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend Lanes operator*(const Lanes a, const Lanes b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend Lanes operator/(const Lanes a, const Lanes b) { return {_mm256_div_ps(a.v, b.v)}; }
+
+    // All bits set in lanes where a < b.
+    friend Lanes less(const Lanes a, const Lanes b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+
+    // value where the mask is set, 0 elsewhere.
+    friend Lanes when(const Lanes mask, const Lanes value) { return {_mm256_and_ps(mask.v, value.v)}; }
+
+    // Union of two masks.
+    friend Lanes either(const Lanes a, const Lanes b) { return {_mm256_or_ps(a.v, b.v)}; }
+
+    // mask ? a : b
+    friend Lanes select(const Lanes mask, const Lanes a, const Lanes b) { return {_mm256_blendv_ps(b.v, a.v, mask.v)}; }
+
+    friend Lanes min(const Lanes a, const Lanes b) { return {_mm256_min_ps(a.v, b.v)}; }
+    friend Lanes max(const Lanes a, const Lanes b) { return {_mm256_max_ps(a.v, b.v)}; }
+    friend Lanes sqrt(const Lanes a) { return {_mm256_sqrt_ps(a.v)}; }
+    friend Lanes rsqrt_estimate(const Lanes a) { return {_mm256_rsqrt_ps(a.v)}; }
+
+    [[nodiscard]] float sum() const {
+        const __m128 half = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        const __m128 pair = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        return _mm_cvtss_f32(_mm_add_ss(pair, _mm_shuffle_ps(pair, pair, 0b01)));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    static Lanes load(const float *p) { return {_mm_loadu_ps(p)}; }
+    static Lanes broadcast(const float f) { return {_mm_set1_ps(f)}; }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend Lanes operator+(const Lanes a, const Lanes b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend Lanes operator-(const Lanes a, const Lanes b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend Lanes operator*(const Lanes a, const Lanes b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend Lanes operator/(const Lanes a, const Lanes b) { return {_mm_div_ps(a.v, b.v)}; }
+
+    friend Lanes less(const Lanes a, const Lanes b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+    friend Lanes when(const Lanes mask, const Lanes value) { return {_mm_and_ps(mask.v, value.v)}; }
+    friend Lanes either(const Lanes a, const Lanes b) { return {_mm_or_ps(a.v, b.v)}; }
+    friend Lanes select(const Lanes mask, const Lanes a, const Lanes b) {
+        return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+    }
+
+    friend Lanes min(const Lanes a, const Lanes b) { return {_mm_min_ps(a.v, b.v)}; }
+    friend Lanes max(const Lanes a, const Lanes b) { return {_mm_max_ps(a.v, b.v)}; }
+    friend Lanes sqrt(const Lanes a) { return {_mm_sqrt_ps(a.v)}; }
+    friend Lanes rsqrt_estimate(const Lanes a) { return {_mm_rsqrt_ps(a.v)}; }
+
+    [[nodiscard]] float sum() const {
+        const __m128 pair = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        return _mm_cvtss_f32(_mm_add_ss(pair, _mm_shuffle_ps(pair, pair, 0b01)));
+    }
+#else
+    static Lanes load(const float *p) { return {*p}; }
+    static Lanes broadcast(const float f) { return {f}; }
+    void store(float *p) const { *p = v; }
+
+    friend Lanes operator+(const Lanes a, const Lanes b) { return {a.v + b.v}; }
+    friend Lanes operator-(const Lanes a, const Lanes b) { return {a.v - b.v}; }
+    friend Lanes operator*(const Lanes a, const Lanes b) { return {a.v * b.v}; }
+    friend Lanes operator/(const Lanes a, const Lanes b) { return {a.v / b.v}; }
+
+    // Scalar masks are 1.0 or 0.0, so when() can multiply. Callers keep masked-out values finite.
+    friend Lanes less(const Lanes a, const Lanes b) { return {FloatEnable[a.v < b.v]}; }
+    friend Lanes when(const Lanes mask, const Lanes value) { return {mask.v * value.v}; }
+    friend Lanes either(const Lanes a, const Lanes b) { return {std::max(a.v, b.v)}; }
+    friend Lanes select(const Lanes mask, const Lanes a, const Lanes b) { return {mask.v != 0.0f ? a.v : b.v}; }
+
+    friend Lanes min(const Lanes a, const Lanes b) { return {std::min(a.v, b.v)}; }
+    friend Lanes max(const Lanes a, const Lanes b) { return {std::max(a.v, b.v)}; }
+    friend Lanes sqrt(const Lanes a) { return {std::sqrt(a.v)}; }
+    friend Lanes rsqrt_estimate(const Lanes a) { return {1.0f / std::sqrt(a.v)}; }
+
+    [[nodiscard]] float sum() const { return v; }
+#endif
+
+    Lanes &operator+=(const Lanes other) { return *this = *this + other; }
+    Lanes &operator-=(const Lanes other) { return *this = *this - other; }
+    Lanes &operator*=(const Lanes other) { return *this = *this * other; }
+};
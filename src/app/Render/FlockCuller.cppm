@@ -0,0 +1,73 @@
+module;
+#include "pch.hpp"
+export module FlockCuller;
+
+import Boid;
+import Boidtree;
+import Rectangle;
+
+// Picks out the boids that can show up in the camera's view, so only those are uploaded and drawn.
+// . With a tree, the view is looked up in it. The tree may have been built from the flock one step back, so the lookup
+//   is grown by the distance a boid covers in a step and every hit is checked again at its current position.
+// . Boids outside the tree's bounds are not in it. A lookup that reaches past those bounds, or a missing tree, falls
+//   back to testing every boid. That is still a pass over the flock, but upload and vertex work follow the view.
+// . A view that covers the whole tree has nothing to cull, so nothing is culled and everything is drawn.
+
+
+bool covers(Rectangle const &outer, Rectangle const &inner) {
+    return outer.contains(inner.center - inner.size) && outer.contains(inner.center + inner.size);
+}
+
+export class FlockCuller {
+public:
+    struct Tree {
+        Boidtree const *tree = nullptr;
+
+        // The flock the tree's items point into, which need not be the one being culled.
+        Boid const *source = nullptr;
+
+        // How far any boid may have moved since the tree was built.
+        float step = 0.0f;
+    };
+
+    // margin is how far outside view a boid's center can be and still draw something inside it.
+    // False when everything is to be drawn. Otherwise visible() holds the indices of the boids to draw.
+    bool cull(Boid const *boids, const size_t count, Rectangle const &view, const float margin, const Tree tree = {}) {
+        m_visible.clear();
+        const Rectangle area {view.center, view.size + Vector {margin}};
+
+        if (tree.tree && tree.source) {
+            const Rectangle lookup {area.center, area.size + Vector {tree.step}};
+            if (covers(lookup, tree.tree->bounds)) {
+                return false;
+            }
+
+            if (covers(tree.tree->bounds, lookup)) {
+                m_candidates.clear();
+                tree.tree->search(lookup, m_candidates);
+                for (Boid const *candidate: m_candidates) {
+                    const ptrdiff_t index = candidate - tree.source;
+                    if (index >= 0 && index < static_cast<ptrdiff_t>(count) && area.contains(boids[index].position)) {
+                        m_visible.push_back(static_cast<uint32_t>(index));
+                    }
+                }
+                return true;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (area.contains(boids[i].position)) {
+                m_visible.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        return m_visible.size() < count;
+    }
+
+    [[nodiscard]] std::vector<uint32_t> const &visible() const {
+        return m_visible;
+    }
+
+private:
+    std::vector<Boid const *> m_candidates;
+    std::vector<uint32_t> m_visible;
+};
@@ -3,8 +3,11 @@ module;
 export module FlockRenderer;
 
 import Boid;
-import Camera;
+import DoubleBuffer;
+import Lanes;
 import RawArray;
+import Rectangle;
+import Resources;
 
 
 export class Object {
@@ -126,6 +129,10 @@ export constexpr std::array<unsigned int, 34> visionIndices {
     15, 16, 16, 0
 };
 
+// One vertex at the boid's center, for drawing boids as points.
+export constexpr std::array<float, 3> pointShape {0.0f, 0.0f, 0.0f};
+export constexpr std::array<unsigned int, 1> pointIndices {0};
+
 export constexpr std::array<float, 24> boxVertices {
     -1.0f, -1.0f, -1.0f,
     1.0f, -1.0f, -1.0f,
@@ -157,9 +164,19 @@ public:
     }
 
     void draw() const {
+        // Every instance culled.
+        if (layout.instances == 0) {
+            return;
+        }
+
         layout.drawElements(mode, count, lwvl::ByteFormat::UnsignedInt);
     }
 
+    // commands is a buffer of DrawElementsIndirectCommands over this model's indices.
+    void draw_indirect(lwvl::Buffer const &commands, const GLsizei draws, const GLintptr offset = 0) const {
+        layout.multiDrawElementsIndirect(mode, lwvl::ByteFormat::UnsignedInt, commands, draws, offset);
+    }
+
     lwvl::VertexArray layout;
     lwvl::Buffer vertices;
     lwvl::Buffer indices;
@@ -170,7 +187,7 @@ public:
     int16_t attribute = 0;
 };
 
-export void attachBoidData(Model *model, lwvl::Buffer& buffer) {
+export void attachBoidData(Model *model, lwvl::Buffer const &buffer) {
     model->layout.array(buffer, 1, 0, sizeof(Boid));
     model->layout.attribute(1, 1, Vector::length(), lwvl::ByteFormat::Float, offsetof(Boid, position));
     model->layout.attribute(1, 2, Vector::length(), lwvl::ByteFormat::Float, offsetof(Boid, velocity));
@@ -178,22 +195,124 @@ export void attachBoidData(Model *model, lwvl::Buffer& buffer) {
 }
 
 
+// Quantized instance data, half the size of a Boid.
+// . x and y are positions normalized over the packing bounds, heading is the direction of travel in turns and speed
+//   is a fraction of Boid::maxSpeed. All four are unsigned 16 bit fixed point in [0, 1].
+// . The shaders get the raw integers as floats and scale them back with the bounds they are given in
+//   BoidShader::unpack_from().
+export struct PackedBoid {
+    uint16_t x, y;
+    uint16_t heading, speed;
+};
+
+export void attachPackedBoidData(Model *model, lwvl::Buffer const &buffer) {
+    model->layout.array(buffer, 1, 0, sizeof(PackedBoid));
+    model->layout.attribute(1, 1, 2, lwvl::ByteFormat::UnsignedShort, offsetof(PackedBoid, x));
+    model->layout.attribute(1, 2, 2, lwvl::ByteFormat::UnsignedShort, offsetof(PackedBoid, heading));
+    model->layout.divisor(1, 1);
+}
+
+// Packs boids a batch at a time. Each batch is transposed to one array per component so the quantization, including
+// a polynomial atan2 good to a few 1e-4 radians, runs on whole lanes.
+// indices, when not null, picks the count boids to pack out of boids.
+export void pack_boids(
+    Boid const *boids, uint32_t const *indices, const size_t count, Rectangle const &bounds, PackedBoid *out
+) {
+    constexpr size_t Batch = 64;
+    static_assert(Batch % LaneCount == 0);
+
+    constexpr float Unorm16 = 65535.0f;
+    constexpr float HalfPi = glm::half_pi<float>();
+    constexpr float Pi = glm::pi<float>();
+
+    const Lanes zero = Lanes::broadcast(0.0f);
+    const Lanes one = Lanes::broadcast(1.0f);
+    const Lanes tiny = Lanes::broadcast(1e-30f);
+    const Lanes left = Lanes::broadcast(bounds.center.x - bounds.size.x);
+    const Lanes bottom = Lanes::broadcast(bounds.center.y - bounds.size.y);
+    const Lanes inverse_width = Lanes::broadcast(0.5f / bounds.size.x);
+    const Lanes inverse_height = Lanes::broadcast(0.5f / bounds.size.y);
+    const Lanes inverse_max_speed = Lanes::broadcast(1.0f / Boid::maxSpeed);
+    const Lanes turns_per_radian = Lanes::broadcast(0.5f / Pi);
+
+    alignas(64) float x[Batch], y[Batch], vx[Batch], vy[Batch];
+    for (size_t first = 0; first < count; first += Batch) {
+        const size_t n = std::min(Batch, count - first);
+        for (size_t i = 0; i < n; ++i) {
+            Boid const &boid = boids[indices ? indices[first + i] : first + i];
+            x[i] = boid.position.x;
+            y[i] = boid.position.y;
+            vx[i] = boid.velocity.x;
+            vy[i] = boid.velocity.y;
+        }
+
+        const size_t padded = (n + LaneCount - 1) / LaneCount * LaneCount;
+        std::fill(x + n, x + padded, 0.0f);
+        std::fill(y + n, y + padded, 0.0f);
+        std::fill(vx + n, vx + padded, 0.0f);
+        std::fill(vy + n, vy + padded, 0.0f);
+
+        for (size_t i = 0; i < padded; i += LaneCount) {
+            const Lanes px = Lanes::load(x + i);
+            const Lanes py = Lanes::load(y + i);
+            const Lanes dx = Lanes::load(vx + i);
+            const Lanes dy = Lanes::load(vy + i);
+
+            max(zero, min(one, (px - left) * inverse_width)).store(x + i);
+            max(zero, min(one, (py - bottom) * inverse_height)).store(y + i);
+
+            // atan of the smaller over the larger component, then folded out to the right octant.
+            const Lanes ax = max(dx, zero - dx);
+            const Lanes ay = max(dy, zero - dy);
+            const Lanes a = min(ax, ay) / (max(ax, ay) + tiny);
+            const Lanes s = a * a;
+            Lanes angle = ((Lanes::broadcast(-0.0464964749f) * s + Lanes::broadcast(0.15931422f)) * s
+                           - Lanes::broadcast(0.327622764f)) * s * a + a;
+            angle = select(less(ax, ay), Lanes::broadcast(HalfPi) - angle, angle);
+            angle = select(less(dx, zero), Lanes::broadcast(Pi) - angle, angle);
+            angle = select(less(dy, zero), zero - angle, angle);
+
+            const Lanes turns = angle * turns_per_radian;
+            (turns + when(less(turns, zero), one)).store(vx + i);
+            min(one, sqrt(dx * dx + dy * dy) * inverse_max_speed).store(vy + i);
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            out[first + i] = {
+                static_cast<uint16_t>(x[i] * Unorm16 + 0.5f),
+                static_cast<uint16_t>(y[i] * Unorm16 + 0.5f),
+                static_cast<uint16_t>(vx[i] * Unorm16 + 0.5f),
+                static_cast<uint16_t>(vy[i] * Unorm16 + 0.5f)
+            };
+        }
+    }
+}
+
+
 export class BoidShader {
 public:
     virtual ~BoidShader() = default;
 
-    void update_camera(const Camera &view) {
+    // Side of the square a point model covers, in pixels.
+    void point_size(const float pixels) {
         control.bind();
-        lwvl::Uniform u_view {control.uniform("view")};
-        if (u_view.location() > -1) {
-            u_view.matrix4F(view.data());
-        }
+        control.uniform("pointSize").setF(pixels);
+        lwvl::Program::clear();
     }
 
+    // Switch to decoding PackedBoid instances packed over bounds.
+    void unpack_from(Rectangle const &bounds) {
+        control.bind();
+        control.uniform("packed").setI(1);
+        control.uniform("packedBounds").setF(bounds.center.x, bounds.center.y, bounds.size.x, bounds.size.y);
+        control.uniform("packedMaxSpeed").setF(Boid::maxSpeed);
+        lwvl::Program::clear();
+    }
+
+    // Leaves the program bound. Whatever draws next binds its own.
     void draw(Model const *model) const {
         control.bind();
         model->draw();
-        lwvl::Program::clear();
     }
 
 protected:
@@ -203,17 +322,16 @@ protected:
 
 export class DefaultBoidShader : public BoidShader {
 public:
-    explicit DefaultBoidShader(Projection &proj) {
+    // boidsprite.frag as the fragment shader turns each point of the point model into a boid.
+    explicit DefaultBoidShader(const char *fragment = "Shaders/boid.frag") {
         control.link(
-            lwvl::VertexShader::readFile("Data/Shaders/boid.vert"),
-            lwvl::FragmentShader::readFile("Data/Shaders/boid.frag")
+            Resources::get().load("Shaders/boid.vert"),
+            Resources::get().load(fragment)
         );
 
         control.bind();
-        control.uniform("scale").setF(Boid::scale);
         Color color = BoidColors[m_color];
         control.uniform("color").setF(color.r, color.g, color.b);
-        control.uniform("projection").matrix4F(&proj[0][0]);
     }
 
     ~DefaultBoidShader() override = default;
@@ -232,15 +350,13 @@ protected:
 
 export class SpeedDebugShader : public BoidShader {
 public:
-    explicit SpeedDebugShader(Projection &proj) {
+    SpeedDebugShader() {
         control.link(
-            lwvl::VertexShader::readFile("Data/Shaders/speeddebug.vert"),
-            lwvl::FragmentShader::readFile("Data/Shaders/speeddebug.frag")
+            Resources::get().load("Shaders/speeddebug.vert"),
+            Resources::get().load("Shaders/speeddebug.frag")
         );
 
         control.bind();
-        control.uniform("scale").setF(Boid::scale);
-        control.uniform("projection").matrix4F(&proj[0][0]);
         control.uniform("maxSpeed").setF(Boid::maxSpeed);
     }
 
@@ -248,55 +364,228 @@ public:
 };
 
 
+// Every vision circle goes out in one multi-draw. The radius of each comes from a storage buffer indexed by gl_DrawID.
+// . The radii are fixed, so they are stored once.
+// . The draw commands only change with the instance count. They are rewritten into the next region of a stream only
+//   then, so neither the upload nor the GPU reading the last commands holds the other up.
 export class VisionShader : public BoidShader {
 public:
-    explicit VisionShader(Projection &proj) {
+    static constexpr size_t MaxCircles = 4;
+
+    // One circle of each radius around every boid. At most MaxCircles radii.
+    explicit VisionShader(std::initializer_list<float> radii) :
+        m_circles(static_cast<GLsizei>(std::min(radii.size(), MaxCircles)))
+    {
         control.link(
-            lwvl::VertexShader::readFile("Data/Shaders/vision.vert"),
-            lwvl::FragmentShader::readFile("Data/Shaders/default.frag")
+            Resources::get().load("Shaders/vision.vert"),
+            Resources::get().load("Shaders/default.frag")
         );
 
         control.bind();
         control.uniform("color").setF(1.0f, 1.0f, 1.0f);
         control.uniform("alpha").setF(0.30f);
-        control.uniform("projection").matrix4F(&proj[0][0]);
+
+        std::array<float, MaxCircles> stored {};
+        std::copy_n(radii.begin(), m_circles, stored.begin());
+        m_radii.store<float>(stored.data(), sizeof(stored));
     }
 
     ~VisionShader() override = default;
 
-    void radius(const float radius) {
+    // The circles around every boid the model draws.
+    void draw(Model const *model) {
+        if (m_circles == 0 || model->layout.instances == 0) {
+            return;
+        }
+
+        const auto count = static_cast<GLuint>(model->count);
+        const GLuint instances = model->layout.instances;
+        if (!m_written || count != m_count || instances != m_instances) {
+            const lwvl::StreamBuffer::Region region = m_commands.acquire(CommandBytes);
+            auto *commands = static_cast<lwvl::DrawElementsIndirectCommand *>(region.data);
+            for (GLsizei i = 0; i < m_circles; ++i) {
+                commands[i] = {count, instances, 0, 0, 0};
+            }
+
+            m_region = region.index;
+            m_offset = region.offset;
+            m_count = count;
+            m_instances = instances;
+            m_written = true;
+        }
+
         control.bind();
-        control.uniform("scale").setF(radius);
+        m_radii.bind(lwvl::Buffer::IndexedTarget::ShaderStorage, RadiiBinding);
+        model->draw_indirect(m_commands.buffer(), m_circles, m_offset);
+
+        // Protects the region for as long as it keeps being drawn from, not just the frame it was written in.
+        m_commands.fence(m_region);
     }
 
 private:
-    lwvl::Uniform u_radius;
+    static constexpr GLuint RadiiBinding = 1;
+    static constexpr GLsizeiptr CommandBytes = MaxCircles * sizeof(lwvl::DrawElementsIndirectCommand);
+
+    GLsizei m_circles;
+    lwvl::Buffer m_radii;
+    lwvl::StreamBuffer m_commands {CommandBytes};
+
+    bool m_written = false;
+    GLuint m_count = 0;
+    GLuint m_instances = 0;
+    GLsizei m_region = 0;
+    GLintptr m_offset = 0;
+};
+
+
+// How much of a boid is drawn, by how many pixels its radius covers at the current zoom.
+// . Mesh: the full model. Sprite: one point as large as the mesh, shaped in the fragment shader. Point: one pixel.
+// . Vision circles smaller than VisionCutoffPixels across their radius are not drawn at all.
+export enum class BoidDetail {
+    Mesh, Sprite, Point
 };
 
+export constexpr float MeshCutoffPixels = 3.0f;
+export constexpr float SpriteCutoffPixels = 1.0f;
+export constexpr float VisionCutoffPixels = 2.0f;
+
+export BoidDetail boid_detail(const float radius_pixels) {
+    if (radius_pixels >= MeshCutoffPixels) {
+        return BoidDetail::Mesh;
+    }
+
+    if (radius_pixels >= SpriteCutoffPixels) {
+        return BoidDetail::Sprite;
+    }
+
+    return BoidDetail::Point;
+}
+
 
-export class FlockRenderer {
+// Instance data for the boid models, streamed through a ring of mapped regions.
+// . Unmapped, update() copies the flock into the next region.
+// . Mapped, the regions are handed to the flock as its DoubleBuffer storage. The simulation writes straight into GL
+//   memory and update() only points the models at the region that was written last, so a frame's boids are neither
+//   copied nor uploaded.
+// . fence() marks the drawn region once the frame's boid draws are submitted. The stream waits on that before the
+//   region is written again, so nothing the GPU may still be drawing is overwritten.
+// . Fences need the GL context, so the flock has to be stepped on the GL thread while mapped.
+// . Mapped, the simulation also reads the last region back for every neighbour search, so the regions are readable
+//   and kept in cached client memory.
+// . Unmapped, update() can also be given the indices of the boids to draw, which are gathered into the region and set
+//   as the models' instance count.
+// . Unmapped, pack() switches the stream to PackedBoid instances, which halves what is written every frame at the cost
+//   of a pack pass. The boid shaders have to be told the same bounds with BoidShader::unpack_from().
+export class FlockRenderer final : public RegionSource<Boid> {
 public:
-    explicit FlockRenderer(size_t size) : flockSize(size) {
-        data.store<float>(nullptr, size * sizeof(Boid), lwvl::bits::Dynamic | lwvl::bits::Client);
+    explicit FlockRenderer(size_t size, const bool mapped = false) :
+        flockSize(size), m_instances(size), m_mapped(mapped),
+        m_stream(static_cast<GLsizeiptr>(size * sizeof(Boid)), 3, mapped) {}
+
+    [[nodiscard]] bool mapped() const {
+        return m_mapped;
+    }
+
+    // Unmapped only, before attaching models. Positions outside bounds are clamped to its edges.
+    void pack(Rectangle const &bounds) {
+        m_packed = true;
+        m_packing = bounds;
+    }
+
+    [[nodiscard]] bool packed() const {
+        return m_packed;
+    }
+
+    // Boids drawn by the last update().
+    [[nodiscard]] size_t instances() const {
+        return m_instances;
+    }
+
+    // Mapped only. Waits until the GPU is done with the region.
+    Boid *next_region() override {
+        return static_cast<Boid *>(m_stream.acquire(bytes(flockSize)).data);
     }
 
     void update(Boid const array[]) {
-        data.update(array, flockSize * sizeof(Boid));
+        m_instances = flockSize;
+        if (m_mapped) {
+            m_drawn = m_stream.region_of(array);
+        } else if (m_packed) {
+            const lwvl::StreamBuffer::Region region = m_stream.acquire(bytes(flockSize));
+            pack_boids(array, nullptr, flockSize, m_packing, static_cast<PackedBoid *>(region.data));
+            m_drawn = region.index;
+        } else {
+            const lwvl::StreamBuffer::Region region = m_stream.acquire(bytes(flockSize));
+            std::memcpy(region.data, array, bytes(flockSize));
+            m_drawn = region.index;
+        }
+
+        for (Model *model: m_models) {
+            bind(model);
+        }
     }
 
+    // Unmapped only. Draws just the boids at the given indices.
+    void update(Boid const array[], std::vector<uint32_t> const &visible) {
+        m_instances = visible.size();
+        const lwvl::StreamBuffer::Region region = m_stream.acquire(bytes(m_instances));
+        if (m_packed) {
+            pack_boids(array, visible.data(), visible.size(), m_packing, static_cast<PackedBoid *>(region.data));
+        } else {
+            auto *out = static_cast<Boid *>(region.data);
+            for (const uint32_t index: visible) {
+                *out++ = array[index];
+            }
+        }
+        m_drawn = region.index;
+
+        for (Model *model: m_models) {
+            bind(model);
+        }
+    }
+
+    // Call once the frame's boid draws are submitted.
+    void fence() {
+        m_stream.fence(m_drawn);
+    }
+
+    // Unmapped only.
     void resize(size_t size) {
-        data.store<float>(nullptr, size * sizeof(Boid), lwvl::bits::Dynamic | lwvl::bits::Client);
         flockSize = size;
     }
 
     void attachData(Model *model) {
-        attachBoidData(model, data);
+        if (m_packed) {
+            attachPackedBoidData(model, m_stream.buffer());
+        } else {
+            attachBoidData(model, m_stream.buffer());
+        }
+        m_models.push_back(model);
     }
 
     static void draw(Model const *model, BoidShader const *shader) {
         shader->draw(model);
     }
 private:
-    lwvl::Buffer data;
+    [[nodiscard]] GLsizei stride() const {
+        return m_packed ? sizeof(PackedBoid) : sizeof(Boid);
+    }
+
+    [[nodiscard]] GLsizeiptr bytes(const size_t count) const {
+        return static_cast<GLsizeiptr>(count * stride());
+    }
+
+    void bind(Model *model) const {
+        model->layout.array(m_stream.buffer(), 1, m_stream.offset(m_drawn), stride());
+        model->layout.instances = static_cast<unsigned int>(m_instances);
+    }
+
     size_t flockSize;
+    size_t m_instances;
+    bool m_mapped;
+    bool m_packed = false;
+    Rectangle m_packing;
+    lwvl::StreamBuffer m_stream;
+    GLsizei m_drawn = 0;
+    std::vector<Model *> m_models;
 };
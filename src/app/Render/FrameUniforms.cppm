@@ -0,0 +1,55 @@
+module;
+#include "pch.hpp"
+export module FrameUniforms;
+
+import Boid;
+import Camera;
+
+// Everything every vertex shader needs from the frame, in one std140 uniform block.
+// . Shaders declare the FrameUniforms block at binding FrameUniformBinding instead of their own view and projection.
+// . update() writes the block into the next region of a stream and binds that range once for the whole frame. No
+//   program is bound and no uniform is set per draw.
+// . fence() once the frame's draws are submitted, like the other streams.
+
+
+export constexpr GLuint FrameUniformBinding = 0;
+
+// Mirrors the block in the shaders. Members in std140 order, padded to a vec4.
+struct FrameBlock {
+    Projection projection;
+    glm::mat4 view;
+    float dt;
+    float boid_scale;
+    float padding[2];
+};
+
+static_assert(sizeof(FrameBlock) == 2 * 64 + 16);
+
+
+export class FrameUniforms {
+public:
+    explicit FrameUniforms(Projection const &projection) : m_projection(projection) {}
+
+    void update(const Camera &view, const float dt) {
+        const lwvl::StreamBuffer::Region region = m_stream.acquire(sizeof(FrameBlock));
+        auto *block = static_cast<FrameBlock *>(region.data);
+        block->projection = m_projection;
+        std::memcpy(&block->view, view.data(), sizeof(block->view));
+        block->dt = dt;
+        block->boid_scale = Boid::scale;
+
+        m_stream.buffer().bind(
+            lwvl::Buffer::IndexedTarget::Uniform, FrameUniformBinding, region.offset, sizeof(FrameBlock)
+        );
+        m_region = region.index;
+    }
+
+    void fence() {
+        m_stream.fence(m_region);
+    }
+
+private:
+    Projection m_projection;
+    lwvl::StreamBuffer m_stream {sizeof(FrameBlock)};
+    GLsizei m_region = 0;
+};
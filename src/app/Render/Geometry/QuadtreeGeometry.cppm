@@ -6,19 +6,15 @@ import Rectangle;
 import Quadtree;
 import Geometry;
 
-export constexpr size_t QuadtreeNodeVertexCount = 6;
-
-export struct QuadtreeVertex {
-    Vector position;
+// One entry per node. The renderer expands each into a quad or an outline in its vertex shaders.
+export struct QuadtreeNode {
+    Vector center;
+    Vector size;
     uint32_t depth;
 };
 
-export void addToArray(QuadtreeVertex *array, size_t depth, Rectangle const &bound) {
-    constexpr int quadrants[QuadtreeNodeVertexCount] {2, 3, 0, 0, 1, 2};
-    for (int i = 0; i < QuadtreeNodeVertexCount; i++) {
-        array[i].position = bound.center + bound.size * QuadrantOffsets[quadrants[i]];
-        array[i].depth = static_cast<uint32_t>(depth);
-    }
+export void addToArray(QuadtreeNode *array, size_t depth, Rectangle const &bound) {
+    *array = {bound.center, bound.size, static_cast<uint32_t>(depth)};
 }
 
 
@@ -33,7 +29,7 @@ public:
 
     void operator()(void *in) override {
         // I can imagine dfs should work backwards from quadrants 4 to 1, but the ordering of the data probably doesn't matter here?
-        auto array = static_cast<QuadtreeVertex *>(in);
+        auto array = static_cast<QuadtreeNode *>(in);
 
         size_t indices[QuadtreeType::MaxDepth + 1];
         indices[0] = 0;
@@ -58,7 +54,7 @@ public:
                 newBound.size = newBound.size * 0.5f;
                 newBound.center = newBound.center + newBound.size * QuadrantOffsets[quadrant];
                 bounds[depth] = newBound;
-                addToArray(array + count++ * QuadtreeNodeVertexCount, depth, newBound);
+                addToArray(array + count++, depth, newBound);
 
                 if (m_tree.node_has_children(node_index)) {
                     indices[++depth] = m_tree.node_child(node_index, 0);
@@ -0,0 +1,102 @@
+module;
+#include "pch.hpp"
+export module HeatmapRenderer;
+
+import Boid;
+import FlockRenderer;
+import QuadtreeRenderer;
+import Rectangle;
+import Resources;
+
+// Flock density instead of individual boids, for flocks too large for glyphs to mean anything.
+// . Every instance is splatted as a single point into a float texture a few screen pixels per texel, blended
+//   additively. Each texel ends up holding how many boids landed on it and the sum of their speeds.
+// . The texture is then stretched over the screen and put through the quadtree's depth palette, by count on a log
+//   scale or by average speed.
+// . The splat touches one texel per boid and the ramp one fragment per pixel, so neither pays for meshes.
+
+
+class SplatShader : public BoidShader {
+public:
+    SplatShader() {
+        control.link(
+            Resources::get().load("Shaders/speeddebug.vert"),
+            Resources::get().load("Shaders/heatsplat.frag")
+        );
+
+        control.bind();
+        control.uniform("pointSize").setF(1.0f);
+    }
+
+    ~SplatShader() override = default;
+};
+
+
+export class HeatmapRenderer {
+    // Counts at or below this never reach the bright end of the ramp, so a sparse view does not light up.
+    static constexpr float MinimumSaturation = 4.0f;
+
+public:
+    HeatmapRenderer(const int width, const int height, const int cell_pixels = 4) :
+        m_screen_width(width), m_screen_height(height),
+        m_width(std::max(1, width / cell_pixels)), m_height(std::max(1, height / cell_pixels))
+    {
+        m_density.format(m_width, m_height, lwvl::ChannelLayout::RG32F);
+        m_density.filter(lwvl::Filter::Linear);
+        m_target.attach(lwvl::Attachment::Color, m_density, 0);
+
+        m_colors.store<glm::vec4>(DEPTH_COLORS, sizeof(DEPTH_COLORS));
+
+        m_ramp.link(
+            Resources::get().load("Shaders/heatmap.vert"),
+            Resources::get().load("Shaders/heatmap.frag")
+        );
+
+        m_ramp.bind();
+        m_ramp.uniform("maxSpeed").setF(Boid::maxSpeed);
+        lwvl::Program::clear();
+    }
+
+    // See BoidShader::unpack_from.
+    void unpack_from(Rectangle const &bounds) {
+        m_splat.unpack_from(bounds);
+    }
+
+    // points is a point model attached to the flock renderer, drawing instances boids.
+    void draw(Model const *points, const size_t instances, const bool by_speed) {
+        constexpr float empty[4] {0.0f, 0.0f, 0.0f, 0.0f};
+        glClearNamedFramebufferfv(m_target.id(), GL_COLOR, 0, empty);
+
+        m_target.bind();
+        glViewport(0, 0, m_width, m_height);
+        glBlendFunc(GL_ONE, GL_ONE);
+        m_splat.draw(points);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glViewport(0, 0, m_screen_width, m_screen_height);
+        lwvl::Framebuffer::clear();
+
+        // A uniform flock would put the mean on every texel. Clusters several times denser than that saturate.
+        const float mean = static_cast<float>(instances) / static_cast<float>(m_width * m_height);
+
+        m_ramp.bind();
+        m_ramp.uniform("saturation").setF(std::max(MinimumSaturation, 8.0f * mean));
+        m_ramp.uniform("bySpeed").setI(by_speed);
+        m_density.bind(0);
+        m_colors.bind(lwvl::Buffer::IndexedTarget::ShaderStorage, 0);
+        m_screen.drawArrays(lwvl::PrimitiveMode::Triangles, 3);
+        lwvl::Program::clear();
+    }
+
+private:
+    SplatShader m_splat;
+    lwvl::Program m_ramp;
+    lwvl::Framebuffer m_target;
+    lwvl::Texture m_density;
+    lwvl::Buffer m_colors;
+
+    // No attributes, the ramp's triangle comes from gl_VertexID.
+    lwvl::VertexArray m_screen;
+
+    int m_screen_width, m_screen_height;
+    int m_width, m_height;
+};
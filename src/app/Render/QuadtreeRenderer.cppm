@@ -4,7 +4,7 @@ export module QuadtreeRenderer;
 
 import Quadtree;
 import QuadtreeGeometry;
-import Camera;
+import Resources;
 
 glm::vec4 lch_to_lab(glm::vec4 color) {
     const float a = glm::cos(glm::radians(color.b)) * color.g;
@@ -107,7 +107,7 @@ get = lambda ccs: print(f"constexpr glm::vec4 DepthColors[{len(ccs)}] {{",",\n".
 //};
 
 // Blue 12
-constexpr glm::vec4 DEPTH_COLORS[12] {
+export constexpr glm::vec4 DEPTH_COLORS[12] {
     {0.43137f, 0.64314f, 0.74902f, 1.0f},
     {0.40392f, 0.60000f, 0.70588f, 1.0f},
     {0.36863f, 0.55294f, 0.65490f, 1.0f},
@@ -141,109 +141,91 @@ constexpr glm::vec4 DEPTH_COLORS[12] {
 
 export class QuadtreeRenderer {
 public:
-    explicit QuadtreeRenderer(Projection &proj) {
-        m_layout.instances = 1;
-        m_layout.array(m_vertices, 0, 0, sizeof(QuadtreeVertex));
-        m_layout.attribute(0, 0, 2, lwvl::ByteFormat::Float, offsetof(QuadtreeVertex, position));
-        m_layout.attribute(0, 1, 1, lwvl::ByteFormat::UnsignedInt, offsetof(QuadtreeVertex, depth));
+    QuadtreeRenderer() {
+        // One instance per node. The vertex shaders place each corner from gl_VertexID.
+        m_layout.instances = 0;
+        m_layout.array(m_nodes.buffer(), 0, 0, sizeof(QuadtreeNode));
+        m_layout.attribute(0, 0, 2, lwvl::ByteFormat::Float, offsetof(QuadtreeNode, center));
+        m_layout.attribute(0, 1, 2, lwvl::ByteFormat::Float, offsetof(QuadtreeNode, size));
+        m_layout.attribute(0, 2, 1, lwvl::ByteFormat::UnsignedInt, offsetof(QuadtreeNode, depth));
+        m_layout.divisor(0, 1);
 
-        m_vertices.store<QuadtreeVertex>(nullptr, m_buffer_size, lwvl::bits::Dynamic);
         m_colors.store<glm::vec4>(DEPTH_COLORS, sizeof(DEPTH_COLORS));
 
-        const lwvl::VertexShader vs = lwvl::VertexShader::fromFile("Data/Shaders/quadtree.vert");
-        const lwvl::GeometryShader gs = lwvl::GeometryShader::fromFile("Data/Shaders/quadtree.geom");
-        const lwvl::FragmentShader fs = lwvl::FragmentShader::fromFile("Data/Shaders/default.frag");
-
-        m_lines_control.attach(vs);
-        m_lines_control.attach(gs);
-        m_lines_control.attach(fs);
-        m_lines_control.link();
-        m_lines_control.detach(vs);
-        m_lines_control.detach(gs);
-        m_lines_control.detach(fs);
+        m_lines_control.link(
+            Resources::get().load("Shaders/quadtree.vert"),
+            Resources::get().load("Shaders/default.frag")
+        );
 
         m_color_control.link(
-            lwvl::VertexShader::fromFile("Data/Shaders/colorquadtree.vert"),
-            lwvl::FragmentShader::fromFile("Data/Shaders/colorquadtree.frag")
+            Resources::get().load("Shaders/colorquadtree.vert"),
+            Resources::get().load("Shaders/colorquadtree.frag")
         );
 
-        m_lines_control.bind();
-        u_lines_view = m_lines_control.uniform("view");
-        m_lines_control.uniform("projection").matrix4F(&proj[0][0]);
         //m_linesControl.uniform("alpha").setF(0.1f);
-
-        m_color_control.bind();
-        u_color_view = m_color_control.uniform("view");
-        m_color_control.uniform("projection").matrix4F(&proj[0][0]);
     }
 
+    // Lay out the tree's nodes, on any thread. upload() sends them later on the main thread.
     template<class T>
-    void update(Quadtree<T> const &tree) {
-        const int nodes = static_cast<int>(tree.size());
-        const int vertex_count = nodes * static_cast<int>(QuadtreeNodeVertexCount);
-        m_primitive_count = nodes * 2;
-        m_vertex_data.resize(vertex_count);
-        {
-            QuadtreeGeometry<T> geometry {tree};
-            geometry(m_vertex_data.data());
-        }
-
-        if (const auto buffer_size = static_cast<GLsizeiptr>(vertex_count * sizeof(QuadtreeVertex)); buffer_size > m_buffer_size) {
-            // Create a new fixed-length buffer and set it as the array buffer of the layout.
-            // This is probably how glCreateBuffer supports variable-length buffers behind the scenes.
-            m_vertices = lwvl::Buffer();
-            m_buffer_size = buffer_size + 1024; // 1024 bytes of headroom before growing again.
-            m_vertices.store<QuadtreeVertex>(
-                nullptr, static_cast<GLsizeiptr>(m_buffer_size), lwvl::bits::Dynamic
-            );
-            m_layout.array(m_vertices, 0, 0, sizeof(QuadtreeVertex));
-        }
+    void build(Quadtree<T> const &tree) {
+        m_node_data.resize(tree.size());
+        QuadtreeGeometry<T> geometry {tree};
+        geometry(m_node_data.data());
+    }
 
-        m_vertices.update(m_vertex_data.begin(), m_vertex_data.end());
+    // Send the last build() to the GPU. Main thread only.
+    void upload() {
+        upload(m_node_data.data(), m_node_data.size());
     }
 
-    void update_camera(const Camera &view) {
-        if (u_lines_view.location() > -1) {
-            m_lines_control.bind();
-            u_lines_view.matrix4F(view.data());
-        }
+    // Send nodes listed elsewhere to the GPU. Main thread only.
+    void upload(QuadtreeNode const *nodes, const size_t count) {
+        const auto bytes = static_cast<GLsizeiptr>(count * sizeof(QuadtreeNode));
+        const lwvl::StreamBuffer::Region region = m_nodes.acquire(bytes);
+        std::memcpy(region.data, nodes, bytes);
+        m_layout.array(m_nodes.buffer(), 0, region.offset, sizeof(QuadtreeNode));
+        m_layout.instances = static_cast<unsigned int>(count);
+        m_region = region.index;
+    }
 
-        if (u_color_view.location() > -1) {
-            m_color_control.bind();
-            u_color_view.matrix4F(view.data());
-        }
+    template<class T>
+    void update(Quadtree<T> const &tree) {
+        build(tree);
+        upload();
     }
 
-    void draw(const bool draw_colors, const bool draw_lines) const {
+    void draw(const bool draw_colors, const bool draw_lines) {
         //m_control.draw(this, [](const void* user_ptr){
         //    const auto* renderer = static_cast<const QuadtreeRenderer*>(user_ptr);
         //    renderer->m_layout.drawElements(lwvl::PrimitiveMode::Triangles, renderer->m_primitiveCount * 3, lwvl::ByteFormat::UnsignedInt);
         //});
 
+        if (m_layout.instances == 0) {
+            return;
+        }
+
         if (draw_colors) {
             m_colors.bind(lwvl::Buffer::IndexedTarget::ShaderStorage, 0);
             m_color_control.bind();
-            m_layout.drawArrays(lwvl::PrimitiveMode::Triangles, m_primitive_count * 3);
+            m_layout.drawArrays(lwvl::PrimitiveMode::TriangleStrip, 4);
         }
 
         if (draw_lines) {
             m_lines_control.bind();
-            m_layout.drawArrays(lwvl::PrimitiveMode::Triangles, m_primitive_count * 3);
+            m_layout.drawArrays(lwvl::PrimitiveMode::LineLoop, 4);
         }
         lwvl::Program::clear();
+        m_nodes.fence(m_region);
     }
 
 private:
     lwvl::Program m_lines_control;
     lwvl::Program m_color_control;
     lwvl::VertexArray m_layout;
-    lwvl::Buffer m_vertices;
+    lwvl::StreamBuffer m_nodes {1024 * sizeof(QuadtreeNode)};
     lwvl::Buffer m_colors;
-    lwvl::Uniform u_lines_view;
-    lwvl::Uniform u_color_view;
-
-    std::vector<QuadtreeVertex> m_vertex_data;
 
-    int m_primitive_count = 0;
-    GLsizeiptr m_buffer_size = 1024 * QuadtreeNodeVertexCount * sizeof(QuadtreeVertex);
+    // Outlives the frame, so it keeps its capacity instead of coming from the frame arena.
+    std::vector<QuadtreeNode> m_node_data;
+    GLsizei m_region = 0;
 };
@@ -3,7 +3,7 @@ module;
 export module RectangleRenderer;
 
 import Rectangle;
-import Camera;
+import Resources;
 
 
 export class RectangleRenderer;
@@ -41,14 +41,14 @@ public:
 
     friend RectangleLink;
 
-    RectangleRenderer(const Projection &projection, const SignedInt initial_size) :
-    m_buffer_size(initial_size * static_cast<SignedInt>(sizeof(RectangleInstance)))
+    explicit RectangleRenderer(const SignedInt initial_size) :
+    m_instances(initial_size * static_cast<SignedInt>(sizeof(RectangleInstance)))
     {
         m_data.reserve(initial_size);
 
         m_layout.instances = 0;
         m_layout.array(m_model, 0, 0, 2 * sizeof(float));
-        m_layout.array(m_instance_buffer, 1, 0, sizeof(RectangleInstance));
+        m_layout.array(m_instances.buffer(), 1, 0, sizeof(RectangleInstance));
         m_layout.attribute(0, 0, 2, lwvl::ByteFormat::Float, 0);
         m_layout.attribute(1, 1, 2, lwvl::ByteFormat::Float, offsetof(RectangleInstance, center));
         m_layout.attribute(1, 2, 2, lwvl::ByteFormat::Float, offsetof(RectangleInstance, size));
@@ -65,32 +65,11 @@ public:
         };
 
         m_model.store(model_data, sizeof(model_data));
-        m_instance_buffer.store<RectangleInstance>(
-            nullptr, m_buffer_size,
-            GL_MAP_WRITE_BIT
-            | GL_MAP_PERSISTENT_BIT
-            | GL_CLIENT_STORAGE_BIT
-        );
-
-        m_mapped_buffer = reinterpret_cast<RectangleInstance*>(glMapNamedBufferRange(
-            m_instance_buffer.id(), 0, m_buffer_size,
-            GL_MAP_WRITE_BIT
-            | GL_MAP_PERSISTENT_BIT
-            | GL_MAP_FLUSH_EXPLICIT_BIT
-            | GL_MAP_INVALIDATE_BUFFER_BIT
-        ));
 
-        lwvl::VertexShader vs {lwvl::VertexShader::fromFile("Data/Shaders/rectangle.vert")};
-        lwvl::FragmentShader fs {lwvl::FragmentShader::fromFile("Data/Shaders/rectangle.frag")};
-
-        m_control.link(vs, fs);
-        m_control.bind();
-        m_control.uniform("projection").matrix4F(&projection[0][0]);
-        u_view = m_control.uniform("view");
-    }
-
-    ~RectangleRenderer() {
-        glUnmapNamedBuffer(m_instance_buffer.id());
+        m_control.link(
+            Resources::get().load("Shaders/rectangle.vert"),
+            Resources::get().load("Shaders/rectangle.frag")
+        );
     }
 
     RectangleLink push(const Rectangle r, const Color c) {
@@ -114,49 +93,39 @@ public:
         return {this, new_id};
     }
 
-    void update() const {
+    void update() {
         const auto count = m_data.size();
-        const auto buffer_size = static_cast<SignedInt>(count * sizeof(RectangleInstance));
-        if (buffer_size > m_buffer_size) {
-            // recreate buffer
-        }
-
+        const lwvl::StreamBuffer::Region region = m_instances.acquire(
+            static_cast<GLsizeiptr>(count * sizeof(RectangleInstance))
+        );
+        auto *instances = static_cast<RectangleInstance *>(region.data);
         for (UnsignedInt i = 0; i < count; ++i) {
             // for each rectangle primitive, extract its components and place them in the buffer.
-            auto & [center, size, color] = m_mapped_buffer[i];
+            auto & [center, size, color] = instances[i];
             const RectanglePrimitive &primitive = m_data[i];
             center = primitive.rectangle.center;
             size = primitive.rectangle.size;
             color = primitive.color;
         }
 
-        glFlushMappedNamedBufferRange(m_instance_buffer.id(), 0, buffer_size);
-        glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+        m_layout.array(m_instances.buffer(), 1, region.offset, sizeof(RectangleInstance));
+        m_region = region.index;
     }
 
-    void update_camera(const Camera &view) {
-        if (u_view.exists()) {
-            m_control.bind();
-            u_view.matrix4F(view.data());
-        }
-    }
-
-    void draw() const {
+    void draw() {
         m_control.bind();
         m_layout.drawArrays(lwvl::PrimitiveMode::LineLoop, 4);
         lwvl::Program::clear();
+        m_instances.fence(m_region);
     }
 private:
     lwvl::Program m_control;
     lwvl::VertexArray m_layout;
-    lwvl::Buffer m_instance_buffer;
+    lwvl::StreamBuffer m_instances;
     lwvl::Buffer m_model;
-    lwvl::Uniform u_view;
 
-    RectangleInstance* m_mapped_buffer;
     std::vector<RectanglePrimitive> m_data;
-
-    SignedInt m_buffer_size;
+    GLsizei m_region = 0;
 };
 
 
@@ -2,6 +2,9 @@ module;
 #include "pch.hpp"
 export module DoubleBuffer;
 
+import Topology;
+import WorkerTeam;
+
 
 inline void* aligned_alloc(size_t alignment, size_t size) {
 #ifdef WIN32
@@ -20,37 +23,196 @@ inline void aligned_free(void* block) {
 }
 
 
+
+// How the pages behind a buffer are backed.
+// . Off leaves it to the heap.
+// . Transparent maps the buffer on a huge page boundary and asks the kernel to back it with huge pages.
+// . Explicit takes pages from the reserved hugetlbfs pool, falling back to Transparent when the pool is empty.
+// . interleave spreads the pages round-robin over every online NUMA node instead of leaving each page on the node
+//   that touches it first.
+// Everything but Off is Linux only and quietly ignored elsewhere.
+export enum class HugePages {
+    Off, Transparent, Explicit
+};
+
+export struct AllocationPolicy {
+    HugePages huge_pages = HugePages::Off;
+    bool interleave = false;
+};
+
+constexpr size_t HugePageSize = size_t {1} << 21;
+
+#ifdef __linux__
+// Online NUMA nodes as a bitmask.
+unsigned long online_nodes() {
+    unsigned long mask = 0;
+    for (const int node: read_id_list("/sys/devices/system/node/online")) {
+        if (node < std::numeric_limits<unsigned long>::digits) {
+            mask |= 1ul << node;
+        }
+    }
+    return mask;
+}
+
+bool mapped(const AllocationPolicy policy) {
+    return policy.huge_pages != HugePages::Off || policy.interleave;
+}
+
+size_t mapped_size(const size_t size) {
+    return (size + HugePageSize - 1) / HugePageSize * HugePageSize;
+}
+
+// Anonymous mapping of length bytes starting on a huge page boundary.
+void *map_aligned(const size_t length) {
+    void *raw = mmap(nullptr, length + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+
+    const auto base = reinterpret_cast<uintptr_t>(raw);
+    const uintptr_t aligned = (base + HugePageSize - 1) / HugePageSize * HugePageSize;
+    if (aligned > base) {
+        munmap(raw, aligned - base);
+    }
+    if (const uintptr_t tail = base + length + HugePageSize - (aligned + length); tail > 0) {
+        munmap(reinterpret_cast<void *>(aligned + length), tail);
+    }
+
+    return reinterpret_cast<void *>(aligned);
+}
+
+void *map_pages(const size_t size, const AllocationPolicy policy) {
+    const size_t length = mapped_size(size);
+    void *pages = nullptr;
+    if (policy.huge_pages == HugePages::Explicit) {
+        pages = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        pages = pages == MAP_FAILED ? nullptr : pages;
+    }
+
+    if (!pages) {
+        pages = map_aligned(length);
+        if (!pages) {
+            return nullptr;
+        }
+
+        if (policy.huge_pages != HugePages::Off) {
+            madvise(pages, length, MADV_HUGEPAGE);
+        }
+    }
+
+    // Has to happen before the first touch. Placement is a hint, so failure is not an error.
+    if (policy.interleave) {
+        const unsigned long nodes = online_nodes();
+        if (std::popcount(nodes) > 1) {
+            constexpr int InterleavePolicy = 3;  // MPOL_INTERLEAVE
+            syscall(SYS_mbind, pages, length, InterleavePolicy, &nodes, std::numeric_limits<unsigned long>::digits + 1, 0);
+        }
+    }
+
+    return pages;
+}
+#endif
+
+void *allocate_pages(const size_t size, const AllocationPolicy policy) {
+#ifdef __linux__
+    if (mapped(policy)) {
+        return map_pages(size, policy);
+    }
+#endif
+    return aligned_alloc(64, size);
+}
+
+void free_pages(void *block, const size_t size, const AllocationPolicy policy) {
+#ifdef __linux__
+    if (mapped(policy)) {
+        if (block) {
+            munmap(block, mapped_size(size));
+        }
+        return;
+    }
+#endif
+    aligned_free(block);
+}
+
+
+// Outside storage for a DoubleBuffer, handed out one buffer-sized region at a time.
+export template<typename T>
+class RegionSource {
+public:
+    virtual ~RegionSource() = default;
+
+    // The next region to write into. Nothing may be reading it anymore.
+    virtual T *next_region() = 0;
+};
+
+
+// Two buffers that trade places every frame. Whatever is written has to be written in full, since the write buffer
+// holds stale data from two frames back, not a copy of the read buffer.
+// . On its own, the buffers are two allocations that swap.
+// . After adopt(), the write buffer comes from a RegionSource each flip and the last one written becomes the read
+//   buffer, so the source can hand out memory that is read elsewhere without another copy.
 export template<typename T>
 class DoubleBuffer {
 public:
-    explicit DoubleBuffer(const size_t initial_count) :
-            m_reserved(initial_count), m_count(initial_count), m_primary(nullptr), m_secondary(nullptr) {
+    explicit DoubleBuffer(const size_t initial_count, const AllocationPolicy policy = {}) :
+            m_reserved(initial_count), m_count(initial_count), m_primary(nullptr), m_secondary(nullptr),
+            m_policy(policy) {
         const size_t allocation_size = initial_count * sizeof(T);
         if (allocation_size == 0) {
             return;
         }
 
-        void* p_primary = aligned_alloc(64, allocation_size);
+        void* p_primary = allocate_pages(allocation_size, m_policy);
         if (!p_primary) {
             throw std::bad_alloc();
         }
         m_primary = static_cast<T*>(p_primary);
 
-        void* p_secondary = aligned_alloc(64, allocation_size);
+        void* p_secondary = allocate_pages(allocation_size, m_policy);
         if (!p_secondary) {
-            aligned_free(p_primary);
+            free_pages(p_primary, allocation_size, m_policy);
             throw std::bad_alloc();
         }
         m_secondary = static_cast<T*>(p_secondary);
     }
 
     ~DoubleBuffer() {
-        aligned_free(m_primary);
-        aligned_free(m_secondary);
+        if (!m_source) {
+            free_pages(m_primary, m_reserved * sizeof(T), m_policy);
+            free_pages(m_secondary, m_reserved * sizeof(T), m_policy);
+        }
+    }
+
+    // Move to outside storage for good. The read buffer's contents carry over.
+    void adopt(RegionSource<T> &source) {
+        T *read = source.next_region();
+        std::copy(m_secondary, m_secondary + m_count, read);
+        if (!m_source) {
+            free_pages(m_primary, m_reserved * sizeof(T), m_policy);
+            free_pages(m_secondary, m_reserved * sizeof(T), m_policy);
+        }
+
+        m_source = &source;
+        m_secondary = read;
+        m_primary = source.next_region();
     }
 
+    // Zero both buffers, one fixed contiguous block per participant, before anything else writes to them.
+    // Pages go to the node of the thread that touches them first, so each block ends up local to its participant.
+    // Buffers that resize() allocates later are touched the same way by the same team.
+    void first_touch(WorkerTeam &team) {
+        m_team = &team;
+        touch(m_primary, m_secondary, m_reserved * sizeof(T));
+    }
+
+    // What was written becomes what is read.
     void flip() {
-        std::copy(m_primary, m_primary + m_count, m_secondary);
+        if (m_source) {
+            m_secondary = m_primary;
+            m_primary = m_source->next_region();
+        } else {
+            std::swap(m_primary, m_secondary);
+        }
     }
 
     T const *read() const {
@@ -62,28 +224,37 @@ public:
     }
 
     void resize(const size_t new_count) {
+        if (new_count > m_reserved && m_source) {
+            throw std::length_error("Outside storage cannot grow.");
+        }
+
         if (new_count > m_reserved) {
             const size_t alloc_size = new_count * sizeof(T);
-            void *p_primary = aligned_alloc(64, alloc_size);
+            void *p_primary = allocate_pages(alloc_size, m_policy);
             if (!p_primary) {
                 throw std::bad_alloc();
             }
             T *new_primary = static_cast<T*>(p_primary);
 
-            void *p_secondary = aligned_alloc(64, alloc_size);
+            void *p_secondary = allocate_pages(alloc_size, m_policy);
             if (!p_secondary) {
-                aligned_free(p_primary);
+                free_pages(p_primary, alloc_size, m_policy);
                 throw std::bad_alloc();
             }
             T *new_secondary = static_cast<T*>(p_secondary);
 
+            // Place the fresh pages before the copies below touch them all from this thread.
+            if (m_team) {
+                touch(new_primary, new_secondary, alloc_size);
+            }
+
             // Could really just copy m_secondary to both new arrays,
             // but it doesn't hurt to support extra functionality.
             std::copy(m_primary, m_primary + m_count, new_primary);
             std::copy(m_secondary, m_secondary + m_count, new_secondary);
 
-            aligned_free(m_primary);
-            aligned_free(m_secondary);
+            free_pages(m_primary, m_reserved * sizeof(T), m_policy);
+            free_pages(m_secondary, m_reserved * sizeof(T), m_policy);
 
             m_primary = new_primary;
             m_secondary = new_secondary;
@@ -101,4 +272,27 @@ public:
 
     T *m_primary;
     T *m_secondary;
+
+    AllocationPolicy m_policy;
+    RegionSource<T> *m_source = nullptr;
+    WorkerTeam *m_team = nullptr;
+
+private:
+    void touch(T *primary, T *secondary, const size_t bytes) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const int participants = m_team->size();
+
+        // Split on page boundaries so no page is touched by two participants. Huge pages are 2 MiB, and splitting
+        // those on 4 KiB would leave each shared page on whichever node got to it first.
+        const size_t page = m_policy.huge_pages != HugePages::Off ? HugePageSize : 4096;
+        m_team->run(
+            [&](const int participant) {
+                const size_t pages = (bytes + page - 1) / page;
+                const size_t first = std::min(bytes, pages * participant / participants * page);
+                const size_t last = std::min(bytes, pages * (participant + 1) / participants * page);
+                std::memset(reinterpret_cast<std::byte *>(primary) + first, 0, last - first);
+                std::memset(reinterpret_cast<std::byte *>(secondary) + first, 0, last - first);
+            }
+        );
+    }
 };
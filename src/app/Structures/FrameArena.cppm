@@ -0,0 +1,125 @@
+module;
+#include "pch.hpp"
+export module FrameArena;
+
+// Thread-local bump arena for memory that lives no longer than a frame.
+// . Allocation is a pointer bump in the calling thread's own arena. No locks, no sharing, nothing to free.
+// . next_frame() starts a new frame for every thread at once. Whichever thread drives the simulation calls it.
+//   Each arena notices on its next allocation and starts over from the beginning, so threads that sit a frame out
+//   cost nothing.
+// . An arena that ran out last frame comes back as one block large enough for all of last frame, so a steady
+//   workload stops touching the heap after its first few frames.
+// . Anything allocated here is gone after next_frame(). Data that has to outlive the frame does not belong here.
+// . It serves the parallel algorithms' per-block bookkeeping, whose size follows the team and the input. Scratch that
+//   is reused every frame at about the same size stays in members that keep their capacity instead.
+
+
+export class FrameArena {
+    // Enough for a radix sort's per-block digit offsets on a team of 128.
+    static constexpr size_t InitialSize = size_t {1} << 18;
+
+    struct Block {
+        std::unique_ptr<std::byte[]> memory;
+        size_t size;
+    };
+
+    static Block make_block(const size_t size) {
+        return {std::make_unique<std::byte[]>(size), size};
+    }
+
+    void reset() {
+        if (m_blocks.size() > 1) {
+            size_t total = 0;
+            for (Block const &block: m_blocks) {
+                total += block.size;
+            }
+
+            m_blocks.clear();
+            m_blocks.push_back(make_block(total));
+        }
+
+        m_offset = 0;
+    }
+
+    FrameArena() {
+        m_blocks.push_back(make_block(InitialSize));
+    }
+
+public:
+    FrameArena(FrameArena const &) = delete;
+    FrameArena &operator=(FrameArena const &) = delete;
+
+    // The calling thread's arena.
+    static FrameArena &local() {
+        thread_local FrameArena arena;
+        return arena;
+    }
+
+    // Call between frames, while no other thread is allocating.
+    // No FrameVector may live past this. Each arena folds its blocks into one on its next allocation and frees the
+    // old ones, which such a vector would still point into.
+    static void next_frame() {
+        s_frame.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] void *allocate(const size_t bytes, const size_t alignment) {
+        if (const uint64_t frame = s_frame.load(std::memory_order_relaxed); frame != m_frame) {
+            m_frame = frame;
+            reset();
+        }
+
+        Block *block = &m_blocks.back();
+        auto base = reinterpret_cast<uintptr_t>(block->memory.get());
+        size_t offset = (base + m_offset + alignment - 1) / alignment * alignment - base;
+        if (offset + bytes > block->size) {
+            m_blocks.push_back(make_block(std::max(block->size * 2, bytes + alignment)));
+            block = &m_blocks.back();
+            base = reinterpret_cast<uintptr_t>(block->memory.get());
+            offset = (base + alignment - 1) / alignment * alignment - base;
+        }
+
+        m_offset = offset + bytes;
+        return block->memory.get() + offset;
+    }
+
+    // Bytes reserved by this thread's arena, for debug output.
+    [[nodiscard]] size_t capacity() const {
+        size_t total = 0;
+        for (Block const &block: m_blocks) {
+            total += block.size;
+        }
+        return total;
+    }
+
+private:
+    inline static std::atomic<uint64_t> s_frame {0};
+
+    std::vector<Block> m_blocks;
+    size_t m_offset = 0;
+    uint64_t m_frame = 0;
+};
+
+
+// Standard allocator over the calling thread's frame arena. Deallocation is a no-op.
+export template<class T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() = default;
+
+    template<class U>
+    ArenaAllocator(ArenaAllocator<U> const &) {}
+
+    [[nodiscard]] T *allocate(const size_t n) {
+        return static_cast<T *>(FrameArena::local().allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    friend bool operator==(ArenaAllocator const &, ArenaAllocator const &) {
+        return true;
+    }
+};
+
+export template<class T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
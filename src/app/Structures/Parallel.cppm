@@ -0,0 +1,214 @@
+module;
+#include "pch.hpp"
+export module Parallel;
+
+export import RawArray;
+import FrameArena;
+import WorkerTeam;
+
+// Data-parallel building blocks on top of a WorkerTeam.
+// . Ranges are RawArrays. Bodies get a slice and the index of its first item, so per-slice setup is paid once.
+// . parallel_for hands slices out dynamically. reduce, exclusive_scan and radix_sort cut the range into one fixed block
+//   per participant instead, so their results never depend on timing.
+// . Anything shorter than a grain runs on the calling thread without waking the team.
+// . Bookkeeping comes from the calling thread's frame arena.
+
+export constexpr ptrdiff_t DefaultGrain = 2048;
+
+template<class T>
+struct alignas(64) Padded {
+    T value;
+};
+
+// Number of fixed blocks worth splitting size items into, at least grain items each.
+int block_count(WorkerTeam const &team, const ptrdiff_t size, const ptrdiff_t grain) {
+    return static_cast<int>(std::clamp<ptrdiff_t>(size / std::max<ptrdiff_t>(grain, 1), 1, team.size()));
+}
+
+// Items [first, last) of block `block` out of `blocks`.
+std::pair<ptrdiff_t, ptrdiff_t> block_range(const ptrdiff_t size, const int block, const int blocks) {
+    return {size * block / blocks, size * (block + 1) / blocks};
+}
+
+// Run job(block) for every block, on the team only if there is more than one.
+template<class Job>
+void for_blocks(WorkerTeam &team, const int blocks, Job const &job) {
+    if (blocks == 1) {
+        job(0);
+        return;
+    }
+
+    team.run(
+        [&](const int participant) {
+            if (participant < blocks) {
+                job(participant);
+            }
+        }
+    );
+}
+
+
+// body(slice, first) over the whole range, in slices of at most grain items.
+export template<class T, class Body>
+void parallel_for(WorkerTeam &team, RawArray<T> range, Body const &body, const ptrdiff_t grain = DefaultGrain) {
+    team.parallel_for(
+        0, static_cast<ptrdiff_t>(range.size()), grain, [&](int, const ptrdiff_t first, const ptrdiff_t last) {
+            body(range.slice(first, last), first);
+        }
+    );
+}
+
+// Fold the range into one value. map(slice) folds a slice on one thread, combine(a, b) joins two folds.
+// Blocks are joined in order, so combine only has to be associative.
+export template<class R, class T, class Map, class Combine>
+R reduce(
+    WorkerTeam &team, RawArray<T> range, const R identity, Map const &map, Combine const &combine,
+    const ptrdiff_t grain = DefaultGrain
+) {
+    const auto size = static_cast<ptrdiff_t>(range.size());
+    const int blocks = block_count(team, size, grain);
+    if (blocks == 1) {
+        return combine(identity, map(range));
+    }
+
+    FrameVector<Padded<R>> partials(blocks, Padded<R> {identity});
+    for_blocks(
+        team, blocks, [&](const int block) {
+            const auto [first, last] = block_range(size, block, blocks);
+            partials[block].value = map(range.slice(first, last));
+        }
+    );
+
+    R result = identity;
+    for (Padded<R> const &partial: partials) {
+        result = combine(result, partial.value);
+    }
+
+    return result;
+}
+
+// out[i] = op(identity, in[0], ..., in[i - 1]). Returns the fold of the whole range.
+// in and out may be the same array.
+export template<class T, class U, class Op>
+T exclusive_scan(
+    WorkerTeam &team, RawArray<U> in, RawArray<T> out, const T identity, Op const &op,
+    const ptrdiff_t grain = DefaultGrain
+) {
+    const auto size = static_cast<ptrdiff_t>(in.size());
+    const int blocks = block_count(team, size, grain);
+
+    // Fold each block, scan the folds on one thread, then scan each block from its offset.
+    FrameVector<Padded<T>> offsets(blocks, Padded<T> {identity});
+    if (blocks > 1) {
+        for_blocks(
+            team, blocks, [&](const int block) {
+                const auto [first, last] = block_range(size, block, blocks);
+                T sum = identity;
+                for (ptrdiff_t i = first; i < last; ++i) {
+                    sum = op(sum, in[i]);
+                }
+                offsets[block].value = sum;
+            }
+        );
+
+        T running = identity;
+        for (Padded<T> &offset: offsets) {
+            const T sum = offset.value;
+            offset.value = running;
+            running = op(running, sum);
+        }
+    }
+
+    // Each block leaves its running fold behind, so the last one holds the total.
+    for_blocks(
+        team, blocks, [&](const int block) {
+            const auto [first, last] = block_range(size, block, blocks);
+            T running = offsets[block].value;
+            for (ptrdiff_t i = first; i < last; ++i) {
+                const T value = in[i];
+                out[i] = running;
+                running = op(running, value);
+            }
+            offsets[block].value = running;
+        }
+    );
+
+    return offsets[blocks - 1].value;
+}
+
+// Stable least-significant-digit radix sort of keys, carrying values along. 8 bits per pass, over the low key_bits.
+// The scratch arrays are as long as keys. Passes where every key has the same digit are skipped.
+export template<std::unsigned_integral K, class V>
+void radix_sort(
+    WorkerTeam &team, RawArray<K> keys, RawArray<V> values, RawArray<K> key_scratch, RawArray<V> value_scratch,
+    const int key_bits = std::numeric_limits<K>::digits, const ptrdiff_t grain = DefaultGrain
+) {
+    constexpr size_t Radix = 256;
+    const auto size = static_cast<ptrdiff_t>(keys.size());
+    const int blocks = block_count(team, size, grain);
+
+    // Per block and digit: first the digit counts, then where the block writes its next item of that digit.
+    FrameVector<size_t> offsets(blocks * Radix);
+    K *source_keys = keys.data();
+    V *source_values = values.data();
+    K *target_keys = key_scratch.data();
+    V *target_values = value_scratch.data();
+
+    for (int shift = 0; shift < key_bits; shift += 8) {
+        const auto digit = [shift](const K key) { return static_cast<size_t>(key >> shift) & (Radix - 1); };
+
+        for_blocks(
+            team, blocks, [&](const int block) {
+                size_t *counts = offsets.data() + block * Radix;
+                std::fill(counts, counts + Radix, 0);
+                const auto [first, last] = block_range(size, block, blocks);
+                for (ptrdiff_t i = first; i < last; ++i) {
+                    ++counts[digit(source_keys[i])];
+                }
+            }
+        );
+
+        // Digit-major, block-minor, so equal digits keep their block order and the sort stays stable.
+        bool uniform = false;
+        size_t running = 0;
+        for (size_t d = 0; d < Radix; ++d) {
+            size_t digit_total = 0;
+            for (int block = 0; block < blocks; ++block) {
+                size_t &offset = offsets[block * Radix + d];
+                const size_t count = offset;
+                offset = running;
+                running += count;
+                digit_total += count;
+            }
+            uniform |= digit_total == static_cast<size_t>(size);
+        }
+
+        if (uniform) {
+            continue;
+        }
+
+        for_blocks(
+            team, blocks, [&](const int block) {
+                size_t *cursors = offsets.data() + block * Radix;
+                const auto [first, last] = block_range(size, block, blocks);
+                for (ptrdiff_t i = first; i < last; ++i) {
+                    const size_t position = cursors[digit(source_keys[i])]++;
+                    target_keys[position] = source_keys[i];
+                    target_values[position] = source_values[i];
+                }
+            }
+        );
+
+        std::swap(source_keys, target_keys);
+        std::swap(source_values, target_values);
+    }
+
+    if (source_keys != keys.data()) {
+        parallel_for(
+            team, RawArray<K>(source_keys, size), [&](RawArray<K> slice, const ptrdiff_t first) {
+                std::copy(slice.begin(), slice.end(), keys.data() + first);
+                std::copy(source_values + first, source_values + first + slice.size(), values.data() + first);
+            }, grain
+        );
+    }
+}
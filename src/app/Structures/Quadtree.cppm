@@ -20,13 +20,37 @@ import Rectangle;
 export constexpr size_t QuadtreeChildCount = 4;
 export constexpr Vector QuadrantOffsets[QuadtreeChildCount] {{1.0f, 1.0f}, {-1.0f, 1.0f}, {-1.0f, -1.0f}, {1.0f, -1.0f}};
 
+// Hilbert curve as a state machine over quadrants. Each of the 4 states is one orientation of the curve.
+// HilbertQuadrants[state] is the order a node's children are visited in, HilbertStates[state] the orientation each of
+//   those children is visited with. Starting from state 0 the curve enters at (-, -) and leaves at (+, -).
+constexpr uint8_t HilbertQuadrants[QuadtreeChildCount][QuadtreeChildCount] {
+    {2, 1, 0, 3}, {2, 3, 0, 1}, {0, 1, 2, 3}, {0, 3, 2, 1}
+};
+constexpr uint8_t HilbertStates[QuadtreeChildCount][QuadtreeChildCount] {
+    {1, 0, 0, 2}, {0, 1, 1, 3}, {3, 2, 2, 0}, {2, 3, 3, 1}
+};
+
 export template<class T>
 struct Quadtree {
     static constexpr size_t BucketItemCount = 8;  // Some multiple that's cache-appropriate
     static constexpr size_t MaxDepth = 11;        // Max 32.
 
     typedef std::array<T, BucketItemCount> Bucket;
-    typedef std::array<Vector, BucketItemCount> Points;
+
+    // Bucket positions stored as separate x and y lanes. With 8 items each lane is exactly one AVX register.
+    struct alignas(32) Points {
+        std::array<float, BucketItemCount> x;
+        std::array<float, BucketItemCount> y;
+
+        Vector operator[](const size_t index) const {
+            return {x[index], y[index]};
+        }
+
+        void set(const size_t index, const Vector position) {
+            x[index] = position.x;
+            y[index] = position.y;
+        }
+    };
     struct BucketList {
         ptrdiff_t next = 0;
         size_t size = 0;
@@ -67,7 +91,7 @@ struct Quadtree {
     inline void add(int point, T data, Vector position) {
         const int point_count = lists[point].size++;
         buckets[point][point_count] = data;
-        points[point][point_count] = position;
+        points[point].set(point_count, position);
     }
 
     inline void new_linked_bucket(ptrdiff_t node) {
@@ -100,15 +124,65 @@ struct Quadtree {
         nodes[node].bucket_index = -1;
     }
 
+    // Bit i is set when item i of the bucket lies inside the area. Same test as Rectangle::contains, a lane at a time.
+    [[nodiscard]] uint32_t contained(const size_t bucket, Rectangle const &area) const {
+        Points const &lanes = points[bucket];
+        const Vector low {area.center - area.size};
+        const Vector high {area.center + area.size};
+        const uint32_t live = (1u << lists[bucket].size) - 1u;
+
+#if defined(__AVX__)
+        static_assert(BucketItemCount == 8);
+        const __m256 x = _mm256_load_ps(lanes.x.data());
+        const __m256 y = _mm256_load_ps(lanes.y.data());
+        const __m256 inside = _mm256_and_ps(
+            _mm256_and_ps(
+                _mm256_cmp_ps(x, _mm256_set1_ps(low.x), _CMP_NLT_UQ),
+                _mm256_cmp_ps(x, _mm256_set1_ps(high.x), _CMP_NGT_UQ)
+            ),
+            _mm256_and_ps(
+                _mm256_cmp_ps(y, _mm256_set1_ps(low.y), _CMP_NLT_UQ),
+                _mm256_cmp_ps(y, _mm256_set1_ps(high.y), _CMP_NGT_UQ)
+            )
+        );
+        return static_cast<uint32_t>(_mm256_movemask_ps(inside)) & live;
+#elif defined(__SSE2__) || defined(_M_X64)
+        static_assert(BucketItemCount % 4 == 0);
+        const __m128 low_x = _mm_set1_ps(low.x);
+        const __m128 high_x = _mm_set1_ps(high.x);
+        const __m128 low_y = _mm_set1_ps(low.y);
+        const __m128 high_y = _mm_set1_ps(high.y);
+        uint32_t mask = 0;
+        for (size_t lane = 0; lane < BucketItemCount; lane += 4) {
+            const __m128 x = _mm_load_ps(lanes.x.data() + lane);
+            const __m128 y = _mm_load_ps(lanes.y.data() + lane);
+            const __m128 inside = _mm_and_ps(
+                _mm_and_ps(_mm_cmpnlt_ps(x, low_x), _mm_cmpngt_ps(x, high_x)),
+                _mm_and_ps(_mm_cmpnlt_ps(y, low_y), _mm_cmpngt_ps(y, high_y))
+            );
+            mask |= static_cast<uint32_t>(_mm_movemask_ps(inside)) << lane;
+        }
+        return mask & live;
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < BucketItemCount; ++i) {
+            const bool inside = !(
+                lanes.x[i] < low.x || lanes.x[i] > high.x ||
+                lanes.y[i] < low.y || lanes.y[i] > high.y
+            );
+            mask |= static_cast<uint32_t>(inside) << i;
+        }
+        return mask & live;
+#endif
+    }
+
     void push(const Rectangle area, const size_t node, std::vector<T> &search_results) const {
         if (node_bucket(node) > -1 && bucket_size(node_bucket(node)) > 0) {
             ptrdiff_t index = node_bucket(node);
             BucketList const *list = &lists.at(index);
             while(true) {
-                for (size_t i = 0; i < list->size; ++i) {
-                    if (area.contains(position(index, i))) {
-                        search_results.push_back(data(index, i));
-                    }
+                for (uint32_t hits = contained(index, area); hits; hits &= hits - 1) {
+                    search_results.push_back(data(index, std::countr_zero(hits)));
                 }
 
                 if (list->next == 0) {
@@ -142,14 +216,16 @@ struct Quadtree {
     }
 
     [[nodiscard]] inline Vector position(size_t point_list, size_t index) const {
-        return points.at(point_list).at(index);
+        return points.at(point_list)[index];
     }
 
     [[nodiscard]] inline size_t size() const {
         return nodes.size();
     }
 
-    explicit Quadtree(Rectangle bounding_box) : bounds(bounding_box) {
+    explicit Quadtree(Rectangle bounding_box, const size_t max_depth = MaxDepth) :
+        bounds(bounding_box), depth_limit(max_depth)
+    {
         initialize();
     }
 
@@ -180,7 +256,7 @@ struct Quadtree {
                     add(bucket, data, position);
                     return true;
                 } else {
-                    if (depth < MaxDepth) {
+                    if (depth < depth_limit) {
                         subdivide(node_index, bucket, current_bound);
                         continue; // Do another loop to see where the new point can fit.
                     } else {
@@ -262,7 +338,158 @@ struct Quadtree {
         }
     }
 
+    // Cells are the 4^levels nodes of a tree subdivided exactly levels deep. A cell's index is its path from the root,
+    //   one quadrant per base-4 digit, most significant first. Same quadrant math as insert(), so a point lands in the
+    //   cell insert() would have walked it to.
+    [[nodiscard]] ptrdiff_t cell(const Vector position, const size_t levels) const {
+        Rectangle current_bound {bounds};
+        if (!current_bound.contains(position)) {
+            return -1;
+        }
+
+        ptrdiff_t path = 0;
+        for (size_t level = 0; level < levels; ++level) {
+            const int quadrant = current_bound.quadrant(position);
+            current_bound.size = current_bound.size * 0.5f;
+            current_bound.center += current_bound.size * QuadrantOffsets[quadrant];
+            path = path * static_cast<ptrdiff_t>(QuadtreeChildCount) + quadrant;
+        }
+
+        return path;
+    }
+
+    [[nodiscard]] Rectangle cell_bounds(const size_t cell, const size_t levels) const {
+        Rectangle current_bound {bounds};
+        for (size_t level = levels; level > 0; --level) {
+            const size_t quadrant = cell >> (2 * (level - 1)) & 0b11;
+            current_bound.size = current_bound.size * 0.5f;
+            current_bound.center += current_bound.size * QuadrantOffsets[quadrant];
+        }
+
+        return current_bound;
+    }
+
+    // Assembling a tree from cells built separately, for example one per thread.
+    // . Each cell is a tree over cell_bounds(cell, levels) with a depth limit of MaxDepth - levels.
+    // . begin_graft() lays out a complete tree levels deep whose leaves are the cells and sizes every array.
+    // . graft() copies one cell into its slot. Slots do not overlap, so cells can be grafted in parallel.
+    void begin_graft(
+        const size_t levels, std::vector<Quadtree> const &cells,
+        std::vector<size_t> &node_offsets, std::vector<size_t> &bucket_offsets
+    ) {
+        const size_t cell_count = cells.size();
+        const size_t top_count = ((size_t {1} << 2 * levels) - 1) / 3;
+        node_offsets.resize(cell_count);
+        bucket_offsets.resize(cell_count);
+
+        size_t node_total = top_count;
+        size_t bucket_total = 0;
+        for (size_t c = 0; c < cell_count; ++c) {
+            node_offsets[c] = node_total;
+            bucket_offsets[c] = bucket_total;
+            node_total += cells[c].nodes.size();
+            bucket_total += cells[c].buckets.size();
+        }
+
+        nodes.resize(node_total);
+        lists.resize(bucket_total);
+        buckets.resize(bucket_total);
+        points.resize(bucket_total);
+
+        // Breadth first. Level l starts at (4^l - 1) / 3 and is ordered by path, so children are found by index.
+        for (size_t level = 0, first = 0; level < levels; ++level) {
+            const size_t width = size_t {1} << 2 * level;
+            const size_t next_first = first + width;
+            for (size_t path = 0; path < width; ++path) {
+                Node &node = nodes[first + path];
+                node.bucket_index = -1;
+                for (size_t child = 0; child < QuadtreeChildCount; ++child) {
+                    const size_t child_path = path * QuadtreeChildCount + child;
+                    node[child] = level + 1 < levels ? next_first + child_path : node_offsets[child_path];
+                }
+            }
+            first = next_first;
+        }
+    }
+
+    void graft(Quadtree const &cell, const size_t node_offset, const size_t bucket_offset) {
+        for (size_t i = 0; i < cell.nodes.size(); ++i) {
+            Node node = cell.nodes[i];
+            if (node.has_children()) {
+                for (size_t &child: node.children) {
+                    child += node_offset;
+                }
+            }
+
+            if (node.bucket_index > -1) {
+                node.bucket_index += static_cast<ptrdiff_t>(bucket_offset);
+            }
+            nodes[node_offset + i] = node;
+        }
+
+        // Bucket links are relative, so buckets move as they are.
+        std::copy(cell.lists.begin(), cell.lists.end(), lists.begin() + static_cast<ptrdiff_t>(bucket_offset));
+        std::copy(cell.buckets.begin(), cell.buckets.end(), buckets.begin() + static_cast<ptrdiff_t>(bucket_offset));
+        std::copy(cell.points.begin(), cell.points.end(), points.begin() + static_cast<ptrdiff_t>(bucket_offset));
+    }
+
+    // Call visit(data) for every item in the tree, leaf by leaf along a Hilbert curve.
+    // Consecutive items are spatially close, and so are the leaves they came from.
+    template<class Visitor>
+    void visit_hilbert(Visitor &&visit) const {
+        auto visit_leaf = [&](const size_t node) {
+            ptrdiff_t index = node_bucket(node);
+            if (index < 0) { return; }
+            while (true) {
+                BucketList const &list = lists[index];
+                for (size_t i = 0; i < list.size; ++i) {
+                    visit(buckets[index][i]);
+                }
+
+                if (list.next == 0) {
+                    break;
+                }
+
+                index += list.next;
+            }
+        };
+
+        if (!node_has_children(0)) {
+            visit_leaf(0);
+            return;
+        }
+
+        // Per level: the node whose children are being walked, its curve orientation, and the next step to take.
+        size_t parents[MaxDepth + 1];
+        uint8_t states[MaxDepth + 1];
+        uint8_t steps[MaxDepth + 1];
+        parents[0] = 0;
+        states[0] = 0;
+        steps[0] = 0;
+        int depth = 0;
+
+        while (depth >= 0) {
+            const uint8_t step = steps[depth]++;
+            if (step >= QuadtreeChildCount) {
+                --depth;
+                continue;
+            }
+
+            const uint8_t state = states[depth];
+            const size_t child = node_child(parents[depth], HilbertQuadrants[state][step]);
+            if (node_has_children(child)) {
+                ++depth;
+                parents[depth] = child;
+                states[depth] = HilbertStates[state][step];
+                steps[depth] = 0;
+            } else {
+                visit_leaf(child);
+            }
+        }
+    }
+
     Rectangle bounds;
+    size_t depth_limit;
     std::vector<BucketList> lists;
     std::vector<Bucket> buckets;
     std::vector<Points> points;
@@ -46,4 +46,21 @@ public:
     iterator end() {
         return iterator(m_data + m_size);
     }
+
+    [[nodiscard]] T *data() const {
+        return m_data;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return m_size;
+    }
+
+    T &operator[](const ptrdiff_t index) const {
+        return m_data[index];
+    }
+
+    // Items [first, last) as their own array.
+    [[nodiscard]] RawArray slice(const ptrdiff_t first, const ptrdiff_t last) const {
+        return {m_data + first, static_cast<std::size_t>(last - first)};
+    }
 };
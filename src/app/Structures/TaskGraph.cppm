@@ -0,0 +1,188 @@
+module;
+#include "pch.hpp"
+export module TaskGraph;
+
+// Frame stages as a dependency graph, run once per frame.
+// . Tasks are declared once, up front, with the tasks they have to wait for. run() executes the whole graph and
+//   returns when every task is done. Tasks read their inputs from whatever they capture, so the graph never changes
+//   between frames.
+// . Main tasks run on the thread that calls run(). That is where GL, GLFW, Lua and WorkerTeam dispatch live.
+// . Any tasks run on the graph's helper thread, or on the calling thread when it has nothing else to do. They must
+//   not touch GL or dispatch to the WorkerTeam, which only the main thread does.
+// . Every run records when each task started, how long it took and where it ran. report() prints that, and
+//   write_dot() writes the graph itself with the same numbers attached.
+
+
+export enum class Affinity {
+    Main, Any
+};
+
+export class TaskGraph {
+public:
+    using Task = size_t;
+
+    struct Timing {
+        // Seconds from the start of run().
+        double start = 0.0;
+        double duration = 0.0;
+        bool on_main = true;
+    };
+
+    TaskGraph() : m_helper([this]() { help(); }) {}
+
+    TaskGraph(TaskGraph const &) = delete;
+    TaskGraph &operator=(TaskGraph const &) = delete;
+
+    ~TaskGraph() {
+        {
+            std::lock_guard lock {m_mutex};
+            m_shutdown = true;
+        }
+        m_changed.notify_all();
+        m_helper.join();
+    }
+
+    // Declare a task that starts after every task in after has finished. Tasks can only wait on earlier tasks,
+    // so the graph is acyclic by construction.
+    Task add(
+        std::string name, const Affinity affinity, std::function<void()> body, std::initializer_list<Task> after = {}
+    ) {
+        const Task task = m_nodes.size();
+        m_nodes.push_back({std::move(name), affinity, std::move(body), {}, after.size()});
+        for (const Task dependency: after) {
+            m_nodes[dependency].dependents.push_back(task);
+        }
+        m_timings.resize(m_nodes.size());
+        m_remaining.resize(m_nodes.size());
+        return task;
+    }
+
+    // Run every task once. Call from the main thread.
+    void run() {
+        std::unique_lock lock {m_mutex};
+        m_start = std::chrono::high_resolution_clock::now();
+        m_unfinished = m_nodes.size();
+        for (Task task = 0; task < m_nodes.size(); ++task) {
+            m_remaining[task] = m_nodes[task].dependencies;
+            if (m_remaining[task] == 0) {
+                ready(task);
+            }
+        }
+        m_changed.notify_all();
+
+        while (m_unfinished > 0) {
+            // Main tasks first, they are the only ones nobody else can take.
+            std::deque<Task> &queue = !m_main_ready.empty() ? m_main_ready : m_any_ready;
+            if (queue.empty()) {
+                m_changed.wait(lock);
+                continue;
+            }
+
+            const Task task = queue.front();
+            queue.pop_front();
+            execute(task, lock, true);
+        }
+    }
+
+    [[nodiscard]] size_t size() const {
+        return m_nodes.size();
+    }
+
+    [[nodiscard]] std::string const &name(const Task task) const {
+        return m_nodes[task].name;
+    }
+
+    // Timings from the last run.
+    [[nodiscard]] Timing const &timing(const Task task) const {
+        return m_timings[task];
+    }
+
+    // One line per task from the last run, in declaration order.
+    void report(std::ostream &stream) const {
+        for (Task task = 0; task < m_nodes.size(); ++task) {
+            Node const &node = m_nodes[task];
+            Timing const &timing = m_timings[task];
+            stream << node.name << ": " << timing.duration * 1000.0 << "ms at +" << timing.start * 1000.0 << "ms on "
+                   << (timing.on_main ? "main" : "helper") << '\n';
+        }
+    }
+
+    // Graphviz description of the graph, labelled with the last run's timings.
+    void write_dot(std::ostream &stream) const {
+        stream << "digraph frame {\n";
+        for (Task task = 0; task < m_nodes.size(); ++task) {
+            Node const &node = m_nodes[task];
+            stream << "    t" << task << " [label=\"" << node.name << "\\n" << m_timings[task].duration * 1000.0
+                   << "ms\", shape=" << (node.affinity == Affinity::Main ? "box" : "ellipse") << "];\n";
+            for (const Task dependent: node.dependents) {
+                stream << "    t" << task << " -> t" << dependent << ";\n";
+            }
+        }
+        stream << "}\n";
+    }
+
+private:
+    struct Node {
+        std::string name;
+        Affinity affinity;
+        std::function<void()> body;
+        std::vector<Task> dependents;
+        size_t dependencies;
+    };
+
+    void ready(const Task task) {
+        (m_nodes[task].affinity == Affinity::Main ? m_main_ready : m_any_ready).push_back(task);
+    }
+
+    // Called and returns with the lock held. The body runs without it.
+    void execute(const Task task, std::unique_lock<std::mutex> &lock, const bool on_main) {
+        using namespace std::chrono;
+        lock.unlock();
+        const auto start = high_resolution_clock::now();
+        m_nodes[task].body();
+        const auto end = high_resolution_clock::now();
+        lock.lock();
+
+        m_timings[task] = {
+            duration<double>(start - m_start).count(), duration<double>(end - start).count(), on_main
+        };
+
+        for (const Task dependent: m_nodes[task].dependents) {
+            if (--m_remaining[dependent] == 0) {
+                ready(dependent);
+            }
+        }
+        --m_unfinished;
+        m_changed.notify_all();
+    }
+
+    void help() {
+        std::unique_lock lock {m_mutex};
+        while (true) {
+            m_changed.wait(lock, [this]() { return m_shutdown || !m_any_ready.empty(); });
+            if (m_shutdown) {
+                return;
+            }
+
+            const Task task = m_any_ready.front();
+            m_any_ready.pop_front();
+            execute(task, lock, false);
+        }
+    }
+
+    std::vector<Node> m_nodes;
+    std::vector<Timing> m_timings;
+
+    // Everything below is guarded by m_mutex while a run is in flight.
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<size_t> m_remaining;
+    std::deque<Task> m_main_ready;
+    std::deque<Task> m_any_ready;
+    size_t m_unfinished = 0;
+    std::chrono::high_resolution_clock::time_point m_start;
+    bool m_shutdown = false;
+
+    // Last, so it starts after everything it reads is constructed.
+    std::thread m_helper;
+};
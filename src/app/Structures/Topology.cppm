@@ -0,0 +1,198 @@
+module;
+#include "pch.hpp"
+export module Topology;
+
+// Processor layout as the kernel reports it under /sys/devices/system, and where to put threads on it.
+// . Every logical CPU knows its core, package, shared L3 and NUMA node, and its rank among its SMT siblings.
+// . order() lists CPUs physical cores first, each pass grouped by node and L3, so a team fills one cache domain
+//   before it spills into the next and only takes SMT siblings once every core has a thread.
+// . Discovery and pinning are Linux only. Elsewhere the topology is empty and nothing is pinned.
+
+
+// Ids in a sysfs list such as "0-3,8,10-11". Missing or unreadable files give an empty list.
+export std::vector<int> read_id_list(const std::string &path) {
+    std::vector<int> ids;
+    std::ifstream file {path};
+    std::string list;
+    if (!(file >> list)) {
+        return ids;
+    }
+
+    for (size_t start = 0; start < list.size();) {
+        size_t end = list.find(',', start);
+        end = end == std::string::npos ? list.size() : end;
+        const std::string range = list.substr(start, end - start);
+        const size_t dash = range.find('-');
+        const int low = std::stoi(range.substr(0, dash));
+        const int high = dash == std::string::npos ? low : std::stoi(range.substr(dash + 1));
+        for (int id = low; id <= high; ++id) {
+            ids.push_back(id);
+        }
+        start = end + 1;
+    }
+
+    return ids;
+}
+
+int read_id(const std::string &path, const int backup) {
+    std::ifstream file {path};
+    int id;
+    return file >> id ? id : backup;
+}
+
+
+export struct Processor {
+    int cpu;
+    int core;
+    int package;
+    int l3;
+    int node;
+
+    // 0 for the first logical CPU of a core, 1 for its SMT sibling, and so on.
+    int smt_rank;
+};
+
+// Where the team's threads go.
+// . pin puts the calling thread on a core of its own and every worker on one logical CPU.
+// . reserved_cores leaves the first few physical cores, with their siblings, to the rest of the system.
+// . priority is a nice value applied to every team thread. Below zero usually needs privileges and is skipped
+//   quietly without them.
+export struct ThreadPlacement {
+    bool pin = false;
+    int reserved_cores = 0;
+    int priority = 0;
+};
+
+
+export class Topology {
+public:
+    static Topology discover() {
+        Topology topology;
+#ifdef __linux__
+        const std::string root = "/sys/devices/system/";
+
+        std::unordered_map<int, int> nodes;
+        for (const int node: read_id_list(root + "node/online")) {
+            for (const int cpu: read_id_list(root + "node/node" + std::to_string(node) + "/cpulist")) {
+                nodes[cpu] = node;
+            }
+        }
+
+        for (const int cpu: read_id_list(root + "cpu/online")) {
+            const std::string path = root + "cpu/cpu" + std::to_string(cpu) + "/";
+            Processor processor {cpu, cpu, 0, 0, 0, 0};
+            processor.core = read_id(path + "topology/core_id", cpu);
+            processor.package = read_id(path + "topology/physical_package_id", 0);
+
+            const std::vector<int> siblings = read_id_list(path + "topology/thread_siblings_list");
+            processor.smt_rank = static_cast<int>(std::ranges::find(siblings, cpu) - siblings.begin());
+            processor.smt_rank = processor.smt_rank == static_cast<int>(siblings.size()) ? 0 : processor.smt_rank;
+
+            // A shared cache is named after the first CPU sharing it.
+            for (int index = 0; ; ++index) {
+                const std::string cache = path + "cache/index" + std::to_string(index) + "/";
+                const int level = read_id(cache + "level", -1);
+                if (level < 0) {
+                    break;
+                }
+
+                if (level == 3) {
+                    const std::vector<int> shared = read_id_list(cache + "shared_cpu_list");
+                    processor.l3 = shared.empty() ? processor.package : shared.front();
+                    break;
+                }
+            }
+
+            const auto node = nodes.find(cpu);
+            processor.node = node == nodes.end() ? 0 : node->second;
+            topology.m_processors.push_back(processor);
+        }
+#endif
+        return topology;
+    }
+
+    [[nodiscard]] std::vector<Processor> const &processors() const {
+        return m_processors;
+    }
+
+    // Every logical CPU, physical cores first, then second siblings and so on. Within a pass by node, L3 and core.
+    [[nodiscard]] std::vector<Processor> order() const {
+        std::vector<Processor> ordered = m_processors;
+        std::ranges::sort(
+            ordered, [](Processor const &a, Processor const &b) {
+                return std::tie(a.smt_rank, a.node, a.l3, a.package, a.core, a.cpu)
+                    < std::tie(b.smt_rank, b.node, b.l3, b.package, b.core, b.cpu);
+            }
+        );
+        return ordered;
+    }
+
+    // CPUs for the calling thread and each of the workers.
+    // The calling thread gets the first core that is not reserved, and none of that core's siblings go to workers.
+    // There are never more worker CPUs than are left over. A cpu of -1 when nothing is known about the machine.
+    [[nodiscard]] std::pair<int, std::vector<int>> assign(const int workers, const int reserved_cores) const {
+        const std::vector<Processor> ordered = order();
+        const int physical = static_cast<int>(std::ranges::count(ordered, 0, &Processor::smt_rank));
+        if (physical == 0) {
+            return {-1, {}};
+        }
+
+        // Always leave the team at least one core.
+        const int reserved = std::clamp(reserved_cores, 0, physical - 1);
+        const auto same_core = [](Processor const &a, Processor const &b) {
+            return a.package == b.package && a.core == b.core;
+        };
+
+        std::vector<Processor> available(ordered.begin() + reserved, ordered.end());
+        for (int r = 0; r < reserved; ++r) {
+            std::erase_if(available, [&](Processor const &p) { return same_core(p, ordered[r]); });
+        }
+
+        const Processor main = available.front();
+        std::erase_if(available, [&](Processor const &p) { return same_core(p, main); });
+
+        std::vector<int> cpus;
+        for (int i = 0; i < workers && i < static_cast<int>(available.size()); ++i) {
+            cpus.push_back(available[i].cpu);
+        }
+
+        return {main.cpu, cpus};
+    }
+
+private:
+    std::vector<Processor> m_processors;
+};
+
+
+// Let the calling thread run on any CPU again after place_current_thread() pinned it.
+export void unpin_current_thread() {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        CPU_SET(cpu, &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
+
+// Pin the calling thread to one logical CPU, or leave it where it is for a negative cpu, and give it a nice value.
+// Best effort: the OS may refuse either.
+export void place_current_thread(const int cpu, const int priority) {
+#ifdef __linux__
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    // Nice values are per thread on Linux.
+    if (priority != 0) {
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), priority);
+    }
+#else
+    (void) cpu;
+    (void) priority;
+#endif
+}
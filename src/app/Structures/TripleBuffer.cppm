@@ -0,0 +1,48 @@
+module;
+#include "pch.hpp"
+export module TripleBuffer;
+
+// Lock-free handoff of whole values from one producer thread to one consumer thread.
+// . The producer fills back() and publish()es it. The consumer asks for the latest published value with acquire().
+// . Neither side ever waits for the other. A producer that outpaces the consumer overwrites values nobody looked at,
+//   and a consumer that outpaces the producer keeps getting the same value back.
+// . The three slots change hands through one atomic word: the index of the middle slot plus a bit that says whether
+//   it holds something the consumer has not seen yet.
+
+
+export template<class T>
+class TripleBuffer {
+    static constexpr uint8_t Fresh = 0b100;
+    static constexpr uint8_t Index = 0b011;
+
+public:
+    // Producer side. The slot being filled.
+    T &back() {
+        return m_slots[m_back];
+    }
+
+    // Producer side. Hand back() over and take the stale middle slot in exchange.
+    void publish() {
+        const uint8_t previous = m_middle.exchange(static_cast<uint8_t>(m_back | Fresh), std::memory_order_acq_rel);
+        m_back = previous & Index;
+    }
+
+    // Consumer side. The latest published value, which stays put until the next acquire().
+    // Null until the producer publishes for the first time.
+    T const *acquire() {
+        if (m_middle.load(std::memory_order_relaxed) & Fresh) {
+            const uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+            m_front = previous & Index;
+            m_received = true;
+        }
+        return m_received ? &m_slots[m_front] : nullptr;
+    }
+
+private:
+    std::array<T, 3> m_slots;
+
+    uint8_t m_back = 0;
+    alignas(64) std::atomic<uint8_t> m_middle {1};
+    alignas(64) uint8_t m_front = 2;
+    bool m_received = false;
+};
@@ -0,0 +1,211 @@
+module;
+#include "pch.hpp"
+export module WorkerTeam;
+
+export import Topology;
+
+// Persistent fork-join team for per-frame work.
+// . The calling thread is always the last participant, so a team of N workers runs N + 1 participants.
+// . Dispatch is a store of a function pointer and a context pointer followed by an epoch bump.
+//   No std::function, no packaged_task, no futures, no queue. Nothing is allocated after construction.
+// . Workers spin on the epoch for a short while before parking on it, which keeps the wake-up cheap at high frame
+//   rates without burning a core while the simulation is paused.
+// . With a pinning placement the calling thread keeps a core to itself and each worker stays on one logical CPU.
+//   A thread that takes over dispatching takes that core over with place_dispatcher().
+
+
+// How long to poll before parking. Frames arrive every few milliseconds, so anything longer just burns power.
+constexpr auto SpinTime = std::chrono::microseconds(20);
+
+// Polls with a pause instruction in between. Past these, the core is given away between polls, which matters when the
+// team outnumbers the cores, and the clock is checked against SpinTime.
+constexpr int PauseIterations = 64;
+
+// Poll until done() or SpinTime runs out. False when it ran out.
+template<class Done>
+bool spin_until(Done const &done) {
+    for (int spin = 0; spin < PauseIterations; ++spin) {
+        if (done()) {
+            return true;
+        }
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + SpinTime;
+    while (!done()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+
+export class WorkerTeam {
+    using Invoke = void (*)(void const *, int);
+
+    void work(const int id, const int cpu, const int priority) {
+        place_current_thread(cpu, priority);
+
+        uint32_t seen = 0;
+        while (true) {
+            // Wait for the next epoch. Spin first, park after.
+            uint32_t epoch = seen;
+            spin_until([&]() { return (epoch = m_epoch.load(std::memory_order_acquire)) != seen; });
+
+            if (epoch == seen) {
+                // Sequentially consistent on both sides so dispatch either sees me sleeping or I see its epoch.
+                m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+                m_epoch.wait(seen, std::memory_order_seq_cst);
+                m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            seen = epoch;
+            if (m_shutdown.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            m_invoke(m_context, id);
+
+            if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                m_pending.notify_one();
+            }
+        }
+    }
+
+    void dispatch(const Invoke invoke, void const *context) {
+        const int workers = static_cast<int>(m_threads.size());
+        m_invoke = invoke;
+        m_context = context;
+        m_pending.store(workers, std::memory_order_relaxed);
+
+        // Publishes the job to every worker that observes the new epoch.
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_seq_cst) > 0) {
+            m_epoch.notify_all();
+        }
+
+        // Do my share.
+        invoke(context, workers);
+
+        // Wait for the others to finish their share.
+        int pending = 0;
+        spin_until([&]() { return (pending = m_pending.load(std::memory_order_acquire)) == 0; });
+
+        while (pending != 0) {
+            m_pending.wait(pending, std::memory_order_acquire);
+            pending = m_pending.load(std::memory_order_acquire);
+        }
+    }
+
+public:
+    // The placement also applies to the calling thread, which should be the one that dispatches from now on.
+    explicit WorkerTeam(const int workers, const ThreadPlacement placement = {}) {
+        int main_cpu = -1;
+        std::vector<int> cpus(workers, -1);
+        if (placement.pin) {
+            // A pinned team shrinks to the CPUs left over rather than doubling up on one.
+            std::tie(main_cpu, cpus) = Topology::discover().assign(workers, placement.reserved_cores);
+            if (main_cpu < 0) {
+                cpus.assign(workers, -1);
+            }
+        }
+        m_dispatcher_cpu = main_cpu;
+        m_priority = placement.priority;
+        place_current_thread(main_cpu, placement.priority);
+
+        m_threads.reserve(cpus.size());
+        for (int i = 0; i < static_cast<int>(cpus.size()); ++i) {
+            m_threads.emplace_back([this, i, cpu = cpus[i], priority = placement.priority]() { work(i, cpu, priority); });
+        }
+    }
+
+    WorkerTeam(WorkerTeam const &) = delete;
+    WorkerTeam(WorkerTeam &&) = delete;
+    WorkerTeam &operator=(WorkerTeam const &) = delete;
+    WorkerTeam &operator=(WorkerTeam &&) = delete;
+
+    ~WorkerTeam() {
+        m_shutdown.store(true, std::memory_order_release);
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        m_epoch.notify_all();
+        for (std::thread &thread: m_threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    // Whether the dispatching thread has a core of its own.
+    [[nodiscard]] bool pinned() const {
+        return m_dispatcher_cpu >= 0;
+    }
+
+    // Give the calling thread the dispatcher's core and priority. For a thread that dispatches in place of the one that
+    // built the team, which should unpin itself.
+    void place_dispatcher() const {
+        place_current_thread(m_dispatcher_cpu, m_priority);
+    }
+
+    // Number of participants, including the calling thread.
+    [[nodiscard]] int size() const {
+        return static_cast<int>(m_threads.size()) + 1;
+    }
+
+    // Run job(participant) once on every participant and return when all of them are done.
+    // The job is borrowed for the duration of the call, so lambdas capturing locals by reference are fine.
+    template<class Job>
+    void run(Job const &job) {
+        dispatch(
+            [](void const *context, const int participant) {
+                (*static_cast<Job const *>(context))(participant);
+            }, &job
+        );
+    }
+
+    // Run body(participant, first, last) over [begin, end) in chunks of at most grain items.
+    // Chunks are claimed dynamically, so a participant that finishes early takes more of the range.
+    template<class Body>
+    void parallel_for(const ptrdiff_t begin, const ptrdiff_t end, const ptrdiff_t grain, Body const &body) {
+        if (end <= begin) { return; }
+        const ptrdiff_t step = std::max<ptrdiff_t>(grain, 1);
+        if (end - begin <= step) {
+            body(size() - 1, begin, end);
+            return;
+        }
+
+        alignas(64) std::atomic<ptrdiff_t> cursor {begin};
+        run(
+            [&](const int participant) {
+                while (true) {
+                    const ptrdiff_t first = cursor.fetch_add(step, std::memory_order_relaxed);
+                    if (first >= end) {
+                        return;
+                    }
+
+                    body(participant, first, std::min(first + step, end));
+                }
+            }
+        );
+    }
+
+private:
+    std::vector<std::thread> m_threads;
+    int m_dispatcher_cpu = -1;
+    int m_priority = 0;
+
+    // Written by the dispatching thread before the epoch is bumped, read by workers after they see it.
+    Invoke m_invoke = nullptr;
+    void const *m_context = nullptr;
+
+    alignas(64) std::atomic<uint32_t> m_epoch {0};
+    alignas(64) std::atomic<int> m_pending {0};
+    alignas(64) std::atomic<int> m_sleeping {0};
+    std::atomic<bool> m_shutdown {false};
+};
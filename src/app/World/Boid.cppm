@@ -2,6 +2,8 @@ module;
 #include "pch.hpp"
 export module Boid;
 
+import Rectangle;
+
 
 export constexpr std::size_t BoidColorCount = 5;
 export constexpr Color BoidColors[BoidColorCount] {
@@ -60,3 +62,54 @@ export inline Vector truncate(const Vector vec, const float max) {
 export inline Vector steer(const Vector vec, const Vector velocity) {
     return truncate(magnitude(vec, Boid::maxSpeed) - velocity, Boid::maxForce);
 }
+
+
+// Raw sums over a boid's neighbors, before any steering. Every algorithm produces one of these per boid.
+export struct Neighborhood {
+    Vector separation {0.0f, 0.0f};  // Sum of offsets away from disruptive neighbors, weighted by 1 / d^2
+    Vector alignment {0.0f, 0.0f};   // Sum of cohesive neighbors' velocities
+    Vector cohesion {0.0f, 0.0f};    // Sum of cohesive neighbors' positions
+    float disruptive_total = 0.0f;
+    float cohesive_total = 0.0f;
+};
+
+// Turn a neighborhood into the acceleration applied to the boid this frame.
+export inline Vector acceleration(const Boid current, Neighborhood n, const Rectangle bounds) {
+    const Rectangle center_bound{bounds * 0.75f};
+    const Rectangle hard_bound{bounds * 0.90f};
+
+    Vector center_steer{0.0f, 0.0f};
+    float center_steer_weight = Boid::primadonnaWeight;
+    if (!center_bound.contains(current.position)) {
+        if (!hard_bound.contains(current.position)) {
+            center_steer_weight *= 2.0f;
+        }
+
+        center_steer -= current.position;
+        center_steer = steer(center_steer, current.velocity);
+    }
+
+    const Vector full_speed = steer(current.velocity, current.velocity);
+
+    if (n.disruptive_total > 0.0f) {
+        n.separation /= n.disruptive_total;
+        n.separation = steer(n.separation, current.velocity);
+    }
+
+    if (n.cohesive_total > 0.0f) {
+        const float countFactor = 1.0f / n.cohesive_total;
+        n.alignment *= countFactor;
+
+        n.cohesion *= countFactor;
+        n.cohesion -= current.position;
+
+        n.alignment = steer(n.alignment, current.velocity);
+        n.cohesion = steer(n.cohesion, current.velocity);
+    }
+
+    return magnitude(
+        Vector{center_steer * center_steer_weight + full_speed * Boid::speedWeight +
+               n.separation * Boid::separationWeight + n.alignment * Boid::alignmentWeight +
+               n.cohesion * Boid::cohesionWeight},
+        Boid::maxForce);
+}
@@ -48,10 +48,11 @@ export void search(const Boidtree &tree, const Boid *self, Rectangle area, std::
                         ptrdiff_t index = tree.node_bucket(node_index);
                         Boidtree::BucketList const *list = &tree.lists.at(index);
                         while(true) {
-                            for (size_t i = 0; i < list->size; ++i) {
-                                // Any way to make this branch-less?
-                                if (area.contains(tree.position(index, i)) && tree.data(index, i) != self) {
-                                    search_results.push_back(*tree.data(index, i));
+                            // Whole bucket in one vector test, then only the hits are visited.
+                            for (uint32_t hits = tree.contained(index, area); hits; hits &= hits - 1) {
+                                const Boid *data = tree.data(index, std::countr_zero(hits));
+                                if (data != self) {
+                                    search_results.push_back(*data);
                                 }
                             }
 
@@ -87,3 +88,105 @@ export void search(const Boidtree &tree, const Boid *self, Rectangle area, std::
 }
 
 
+// Number of boids that share one traversal in a packet search.
+export constexpr size_t SearchPacketSize = 8;
+
+// A group of spatially adjacent queries. Members are usually consecutive boids along the work order.
+export struct SearchPacket {
+    size_t size = 0;
+    const Boid *selves[SearchPacketSize] {};
+    Rectangle areas[SearchPacketSize] {};
+};
+
+export using PacketResults = std::array<std::vector<Boid>, SearchPacketSize>;
+
+// Walks the tree once for every member of the packet.
+// Nodes are tested against the union of the members' areas. At each leaf the members whose area touches the leaf
+//   are collected into a mask, and each of those members filters the leaf's buckets with one vector test per bucket.
+export void search(const Boidtree &tree, SearchPacket const &packet, PacketResults &search_results) {
+    if (packet.size == 0) { return; }
+
+    Vector low {packet.areas[0].center - packet.areas[0].size};
+    Vector high {packet.areas[0].center + packet.areas[0].size};
+    for (size_t m = 1; m < packet.size; ++m) {
+        low = glm::min(low, packet.areas[m].center - packet.areas[m].size);
+        high = glm::max(high, packet.areas[m].center + packet.areas[m].size);
+    }
+
+    const Rectangle area {(low + high) * 0.5f, (high - low) * 0.5f};
+    if (tree.bounds.intersects(area)) {
+        size_t indices[Boidtree::MaxDepth + 1];
+        indices[0] = 0;
+        indices[1] = tree.node_child(0, 0);
+        Rectangle terrace[Boidtree::MaxDepth + 1];
+        terrace[0] = Rectangle{tree.bounds};
+        if (!indices[1]) { return; }
+
+        uint64_t quadrant_memory = 0;
+        int depth = 1;
+        bool ascended = false;
+
+        while (true) {
+            uint8_t quadrant = quadrant_memory & 0b11;
+            const size_t node_index = indices[depth];
+
+            if (!ascended) {
+                Rectangle new_bound{terrace[depth - 1]};
+                new_bound.size = new_bound.size * 0.5f;
+                new_bound.center = new_bound.center + new_bound.size * QuadrantOffsets[quadrant];
+                terrace[depth] = new_bound;
+
+                if (tree.node_has_children(node_index) && new_bound.intersects(area)) {
+                    indices[++depth] = tree.node_child(node_index, 0);
+                    quadrant_memory <<= 2;
+                    continue;
+                } else if (new_bound.intersects(area)) {
+                    // Bottom. Find out who can see this leaf, then hand each point to them.
+                    uint32_t active = 0;
+                    for (size_t m = 0; m < packet.size; ++m) {
+                        active |= static_cast<uint32_t>(new_bound.intersects(packet.areas[m])) << m;
+                    }
+
+                    if (active && tree.node_bucket(node_index) > -1 && tree.bucket_size(tree.node_bucket(node_index)) > 0) {
+                        ptrdiff_t index = tree.node_bucket(node_index);
+                        Boidtree::BucketList const *list = &tree.lists[index];
+                        while (true) {
+                            for (uint32_t members = active; members; members &= members - 1) {
+                                const int m = std::countr_zero(members);
+                                for (uint32_t hits = tree.contained(index, packet.areas[m]); hits; hits &= hits - 1) {
+                                    const Boid *data = tree.data(index, std::countr_zero(hits));
+                                    if (data != packet.selves[m]) {
+                                        search_results[m].push_back(*data);
+                                    }
+                                }
+                            }
+
+                            if (list->next == 0) {
+                                break;
+                            }
+
+                            index += list->next;
+                            list = &tree.lists[index];
+                        }
+                    }
+                }
+            }
+
+            ++quadrant;
+
+            if (quadrant >= QuadtreeChildCount) {
+                quadrant_memory >>= 2;
+                ascended = true;
+                --depth;
+
+                if (!depth) {
+                    break;
+                }
+            } else {
+                indices[depth] = tree.node_child(indices[depth - 1], quadrant);
+                quadrant_memory += 1;
+                ascended = false;
+            }
+        }
+    }
+}
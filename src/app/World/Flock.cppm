@@ -5,15 +5,21 @@ export module Flock;
 import Algorithm;
 import DoubleBuffer;
 import Boid;
+import WorkerTeam;
 
 
 export class Flock {
     // without any steering, this number can go above 500,000 before dipping below 60fps
     size_t m_count;
     DoubleBuffer<Boid> m_flock;
+    WorkerTeam &m_team;
 
 public:
-    explicit Flock(const size_t flock_size) : m_count(flock_size), m_flock(flock_size) {
+    Flock(const size_t flock_size, WorkerTeam &team, const AllocationPolicy policy = {}) :
+            m_count(flock_size), m_flock(flock_size, policy), m_team(team) {
+        // Place the pages with the team before the single threaded setup below gets to touch them.
+        m_flock.first_touch(m_team);
+
         // Set up boid starting locations
         Boid *writable = m_flock.write();
 
@@ -40,6 +46,11 @@ public:
         m_flock.flip();
     }
 
+    // Keep the flock in outside storage from now on, see DoubleBuffer::adopt.
+    void adopt(RegionSource<Boid> &source) {
+        m_flock.adopt(source);
+    }
+
     [[nodiscard]] Boid const *boids() const {
         return m_flock.read();
     }
@@ -0,0 +1,130 @@
+module;
+#include "pch.hpp"
+export module SimulationThread;
+
+import Algorithm;
+import Boid;
+import Boidtree;
+import Flock;
+import FrameArena;
+import Parallel;
+import QuadtreeGeometry;
+import ThreadedAlgorithm;
+import TripleBuffer;
+import WorkerTeam;
+
+// Runs the flock on a thread of its own, so a frame costs max(simulation, rendering) instead of their sum.
+// . The simulation thread drives the worker team and owns the frame arenas' clock. Nothing else may dispatch to the
+//   team or call FrameArena::next_frame() while it runs.
+// . It also takes over the core a pinned team reserved for its dispatcher. The thread that starts it, which only
+//   renders from then on, is unpinned and left to the scheduler.
+// . Every step ends in a Generation: a copy of the flock and, when asked for, the tree's debug geometry. Generations
+//   go through a triple buffer, so the render thread always picks up the latest finished one without waiting.
+
+
+export struct Generation {
+    std::vector<Boid> boids;
+    std::vector<QuadtreeNode> quadtree;
+    uint64_t number = 0;
+
+    // Seconds the step itself took, handoff included.
+    double step_time = 0.0;
+};
+
+export class SimulationThread {
+public:
+    // tree_algorithm, when not null, is where quadtree geometry comes from.
+    SimulationThread(Flock &flock, Algorithm *algorithm, ThreadedAlgorithm *tree_algorithm, WorkerTeam &team) :
+            m_flock(flock), m_algorithm(algorithm), m_tree_algorithm(tree_algorithm), m_team(team),
+            m_thread([this]() { run(); }) {
+        if (m_team.pinned()) {
+            unpin_current_thread();
+        }
+    }
+
+    SimulationThread(SimulationThread const &) = delete;
+    SimulationThread &operator=(SimulationThread const &) = delete;
+
+    ~SimulationThread() {
+        m_running.store(false, std::memory_order_relaxed);
+        m_thread.join();
+    }
+
+    void paused(const bool paused) {
+        m_paused.store(paused, std::memory_order_relaxed);
+    }
+
+    void capture_quadtree(const bool capture) {
+        m_capture_quadtree.store(capture, std::memory_order_relaxed);
+    }
+
+    // Render thread only. Stays valid until the next call. Null until the first step is done.
+    Generation const *latest() {
+        return m_generations.acquire();
+    }
+
+private:
+    void run() {
+        m_team.place_dispatcher();
+
+        using namespace std::chrono;
+        auto step_start = high_resolution_clock::now();
+        uint64_t number = 0;
+
+        while (m_running.load(std::memory_order_relaxed)) {
+            const auto now = high_resolution_clock::now();
+            const auto dt = static_cast<float>(duration<double>(now - step_start).count());
+            step_start = now;
+
+            // Publish the starting positions once even when paused, so there is something to draw.
+            if (m_paused.load(std::memory_order_relaxed) && number > 0) {
+                std::this_thread::sleep_for(milliseconds(1));
+                continue;
+            }
+
+            FrameArena::next_frame();
+            if (number > 0) {
+                m_flock.update(m_algorithm, dt);
+            }
+
+            Generation &generation = m_generations.back();
+            generation.boids.resize(m_flock.count());
+            parallel_for(
+                m_team, RawArray<const Boid>(m_flock.boids(), m_flock.count()),
+                [&](RawArray<const Boid> slice, const ptrdiff_t first) {
+                    std::copy(slice.begin(), slice.end(), generation.boids.begin() + first);
+                }
+            );
+
+            generation.quadtree.clear();
+            if (m_tree_algorithm && m_capture_quadtree.load(std::memory_order_relaxed)) {
+                const Boidtree &tree = m_tree_algorithm->tree();
+                generation.quadtree.resize(tree.size());
+                QuadtreeGeometry<const Boid *> geometry {tree};
+                geometry(generation.quadtree.data());
+            }
+
+            generation.number = ++number;
+            generation.step_time = duration<double>(high_resolution_clock::now() - step_start).count();
+            m_generations.publish();
+
+            // Same pacing as the single threaded loop.
+            if (generation.step_time <= 0.008) {
+                std::this_thread::sleep_for(milliseconds(1));
+            }
+        }
+    }
+
+    Flock &m_flock;
+    Algorithm *m_algorithm;
+    ThreadedAlgorithm *m_tree_algorithm;
+    WorkerTeam &m_team;
+
+    TripleBuffer<Generation> m_generations;
+    std::atomic<bool> m_running {true};
+    std::atomic<bool> m_paused {false};
+    std::atomic<bool> m_capture_quadtree {false};
+
+    // Last, so it starts after everything it reads is constructed.
+    std::thread m_thread;
+};
@@ -0,0 +1,316 @@
+module;
+#include "pch.hpp"
+export module Steering;
+
+import Boid;
+import Lanes;
+import Rectangle;
+
+// Steering for many boids at once.
+// . Vectors are split into x and y arrays and worked on LaneCount boids per step.
+// . Every inverse square root of the pass goes through inverse_sqrt(), so its precision is a single switch.
+// . The scalar magnitude(), truncate(), steer() and acceleration() in Boid stay as the reference.
+
+export enum class SteeringMode {
+    Fast,      // Hardware estimate only, about 12 bits.
+    Accurate,  // Estimate plus one Newton-Raphson step. As close as fastInverseSqrt, at a fraction of the cost.
+    Exact      // 1 / sqrt, correctly rounded.
+};
+
+export SteeringMode steering_mode = SteeringMode::Accurate;
+
+// Arrays handed to the batch functions hold at least this many entries. The padding is worked on and thrown away.
+export constexpr size_t padded(const size_t count) {
+    return (count + LaneCount - 1) / LaneCount * LaneCount;
+}
+
+// Squared lengths are clamped to this, so zero vectors stay zero instead of turning into NaN.
+constexpr float SmallestLengthSquared = std::numeric_limits<float>::min();
+
+
+template<SteeringMode Mode>
+inline Lanes inverse_sqrt(const Lanes d2) {
+    const Lanes d = max(d2, Lanes::broadcast(SmallestLengthSquared));
+    if constexpr (Mode == SteeringMode::Fast) {
+        return rsqrt_estimate(d);
+    } else if constexpr (Mode == SteeringMode::Accurate) {
+        const Lanes y = rsqrt_estimate(d);
+        return y * (Lanes::broadcast(1.5f) - Lanes::broadcast(0.5f) * d * y * y);
+    } else {
+        return Lanes::broadcast(1.0f) / sqrt(d);
+    }
+}
+
+
+struct LaneVector {
+    Lanes x, y;
+
+    friend LaneVector operator+(const LaneVector a, const LaneVector b) { return {a.x + b.x, a.y + b.y}; }
+    friend LaneVector operator-(const LaneVector a, const LaneVector b) { return {a.x - b.x, a.y - b.y}; }
+    friend LaneVector operator*(const LaneVector a, const Lanes s) { return {a.x * s, a.y * s}; }
+};
+
+template<SteeringMode Mode>
+inline LaneVector magnitude(const LaneVector vec, const Lanes mag) {
+    return vec * (inverse_sqrt<Mode>(vec.x * vec.x + vec.y * vec.y) * mag);
+}
+
+template<SteeringMode Mode>
+inline LaneVector truncate(const LaneVector vec, const Lanes max) {
+    const Lanes i = max * inverse_sqrt<Mode>(vec.x * vec.x + vec.y * vec.y);
+    return vec * min(i, Lanes::broadcast(1.0f));
+}
+
+template<SteeringMode Mode>
+inline LaneVector steer(const LaneVector vec, const LaneVector velocity) {
+    return truncate<Mode>(
+        magnitude<Mode>(vec, Lanes::broadcast(Boid::maxSpeed)) - velocity, Lanes::broadcast(Boid::maxForce)
+    );
+}
+
+// Mask of the lanes where p lies outside of the rectangle. Same edges as Rectangle::contains.
+inline Lanes outside(const Rectangle &r, const LaneVector p) {
+    return either(
+        either(less(p.x, Lanes::broadcast(r.center.x - r.size.x)), less(Lanes::broadcast(r.center.x + r.size.x), p.x)),
+        either(less(p.y, Lanes::broadcast(r.center.y - r.size.y)), less(Lanes::broadcast(r.center.y + r.size.y), p.y))
+    );
+}
+
+
+// Array versions. x, y, vx and vy hold padded(count) entries.
+export template<SteeringMode Mode>
+void magnitude(float *x, float *y, const size_t count, const float mag) {
+    for (size_t k = 0; k < count; k += LaneCount) {
+        const LaneVector result = magnitude<Mode>({Lanes::load(x + k), Lanes::load(y + k)}, Lanes::broadcast(mag));
+        result.x.store(x + k);
+        result.y.store(y + k);
+    }
+}
+
+export template<SteeringMode Mode>
+void truncate(float *x, float *y, const size_t count, const float max) {
+    for (size_t k = 0; k < count; k += LaneCount) {
+        const LaneVector result = truncate<Mode>({Lanes::load(x + k), Lanes::load(y + k)}, Lanes::broadcast(max));
+        result.x.store(x + k);
+        result.y.store(y + k);
+    }
+}
+
+export template<SteeringMode Mode>
+void steer(float *x, float *y, const float *vx, const float *vy, const size_t count) {
+    for (size_t k = 0; k < count; k += LaneCount) {
+        const LaneVector result = steer<Mode>(
+            {Lanes::load(x + k), Lanes::load(y + k)}, {Lanes::load(vx + k), Lanes::load(vy + k)}
+        );
+        result.x.store(x + k);
+        result.y.store(y + k);
+    }
+}
+
+
+export constexpr size_t SteeringBatchSize = 64;
+static_assert(SteeringBatchSize % LaneCount == 0);
+
+// Inputs and outputs of one force-resolution pass, one array per component.
+// Algorithms push each boid's neighborhood as they finish it and resolve the whole batch when it fills up.
+export struct alignas(32) SteeringBatch {
+    static constexpr size_t N = SteeringBatchSize;
+
+    void push(const uint32_t i, Boid const &boid, Neighborhood const &n) {
+        index[size] = i;
+        position_x[size] = boid.position.x;
+        position_y[size] = boid.position.y;
+        velocity_x[size] = boid.velocity.x;
+        velocity_y[size] = boid.velocity.y;
+        separation_x[size] = n.separation.x;
+        separation_y[size] = n.separation.y;
+        alignment_x[size] = n.alignment.x;
+        alignment_y[size] = n.alignment.y;
+        cohesion_x[size] = n.cohesion.x;
+        cohesion_y[size] = n.cohesion.y;
+        disruptive_total[size] = n.disruptive_total;
+        cohesive_total[size] = n.cohesive_total;
+        ++size;
+    }
+
+    [[nodiscard]] bool full() const { return size == N; }
+
+    void clear() { size = 0; }
+
+    // Lanes past size hold whatever the last batch left there. Always finite, never written back.
+    float position_x[N] {}, position_y[N] {};
+    float velocity_x[N] {}, velocity_y[N] {};
+    float separation_x[N] {}, separation_y[N] {};
+    float alignment_x[N] {}, alignment_y[N] {};
+    float cohesion_x[N] {}, cohesion_y[N] {};
+    float disruptive_total[N] {}, cohesive_total[N] {};
+    float acceleration_x[N] {}, acceleration_y[N] {};
+    uint32_t index[N] {};
+    size_t size = 0;
+};
+
+
+// Vectorized acceleration() over a whole batch.
+export template<SteeringMode Mode>
+void resolve(SteeringBatch &batch, const Rectangle bounds) {
+    const Rectangle center_bound {bounds * 0.75f};
+    const Rectangle hard_bound {bounds * 0.90f};
+    const Lanes zero = Lanes::broadcast(0.0f);
+    const Lanes one = Lanes::broadcast(1.0f);
+
+    for (size_t k = 0; k < batch.size; k += LaneCount) {
+        const LaneVector position {Lanes::load(batch.position_x + k), Lanes::load(batch.position_y + k)};
+        const LaneVector velocity {Lanes::load(batch.velocity_x + k), Lanes::load(batch.velocity_y + k)};
+
+        // Steer home from outside the center bound, twice as hard from outside the hard bound.
+        const Lanes primadonna = Lanes::broadcast(Boid::primadonnaWeight) * (one + when(outside(hard_bound, position), one));
+        const Lanes center_weight = when(outside(center_bound, position), primadonna);
+        const LaneVector center_steer = steer<Mode>({zero - position.x, zero - position.y}, velocity);
+
+        const LaneVector full_speed = steer<Mode>(velocity, velocity);
+
+        // Totals are whole counts, so clamping to 1 only touches the lanes that get masked out anyway.
+        const Lanes disruptive_total = Lanes::load(batch.disruptive_total + k);
+        const Lanes disruptive_factor = one / max(disruptive_total, one);
+        const Lanes separation_weight = when(less(zero, disruptive_total), Lanes::broadcast(Boid::separationWeight));
+        const LaneVector separation = steer<Mode>(
+            LaneVector {Lanes::load(batch.separation_x + k), Lanes::load(batch.separation_y + k)} * disruptive_factor,
+            velocity
+        );
+
+        const Lanes cohesive_total = Lanes::load(batch.cohesive_total + k);
+        const Lanes cohesive_factor = one / max(cohesive_total, one);
+        const Lanes has_cohesive = less(zero, cohesive_total);
+        const Lanes alignment_weight = when(has_cohesive, Lanes::broadcast(Boid::alignmentWeight));
+        const Lanes cohesion_weight = when(has_cohesive, Lanes::broadcast(Boid::cohesionWeight));
+        const LaneVector alignment = steer<Mode>(
+            LaneVector {Lanes::load(batch.alignment_x + k), Lanes::load(batch.alignment_y + k)} * cohesive_factor,
+            velocity
+        );
+        const LaneVector cohesion = steer<Mode>(
+            LaneVector {Lanes::load(batch.cohesion_x + k), Lanes::load(batch.cohesion_y + k)} * cohesive_factor -
+            position, velocity
+        );
+
+        const LaneVector result = magnitude<Mode>(
+            center_steer * center_weight + full_speed * Lanes::broadcast(Boid::speedWeight) +
+            separation * separation_weight + alignment * alignment_weight + cohesion * cohesion_weight,
+            Lanes::broadcast(Boid::maxForce)
+        );
+
+        result.x.store(batch.acceleration_x + k);
+        result.y.store(batch.acceleration_y + k);
+    }
+}
+
+export void resolve(SteeringBatch &batch, const Rectangle bounds, const SteeringMode mode) {
+    switch (mode) {
+        case SteeringMode::Fast: resolve<SteeringMode::Fast>(batch, bounds);
+            return;
+        case SteeringMode::Accurate: resolve<SteeringMode::Accurate>(batch, bounds);
+            return;
+        case SteeringMode::Exact: resolve<SteeringMode::Exact>(batch, bounds);
+            return;
+    }
+}
+
+// Resolve the batch and move every boid in it. Every written boid is assigned in full, nothing of the write buffer's
+// previous contents survives.
+export void integrate(SteeringBatch &batch, const Rectangle bounds, const Boid *read, Boid *write, const float delta) {
+    resolve(batch, bounds, steering_mode);
+    for (size_t k = 0; k < batch.size; ++k) {
+        const uint32_t i = batch.index[k];
+        write[i].velocity = read[i].velocity + Vector {batch.acceleration_x[k], batch.acceleration_y[k]};
+        write[i].position = read[i].position + read[i].velocity * delta;
+    }
+
+    batch.clear();
+}
+
+
+// Error of each mode against 1 / std::sqrt, and the cost of a batch magnitude() in each mode.
+// fastInverseSqrt, the scalar path, is measured alongside for comparison.
+export void steering_report(std::ostream &os) {
+    constexpr size_t Samples = 1 << 16;
+    constexpr int Repeats = 64;
+
+    // Lengths from 0.001 to 1000, every direction. Covers everything the simulation feeds in.
+    std::mt19937 generator {0x5EED};
+    std::uniform_real_distribution<float> exponent {-3.0f, 3.0f};
+    std::uniform_real_distribution<float> angle {0.0f, glm::two_pi<float>()};
+    std::vector<float> x(Samples), y(Samples), d2(Samples), inverse(Samples);
+    for (size_t i = 0; i < Samples; ++i) {
+        const float length = std::pow(10.0f, exponent(generator));
+        const float theta = angle(generator);
+        x[i] = length * std::cos(theta);
+        y[i] = length * std::sin(theta);
+        d2[i] = x[i] * x[i] + y[i] * y[i];
+    }
+
+    const auto report = [&](const char *name, auto &&inverse_of, auto &&magnitude_of) {
+        for (size_t i = 0; i < Samples; i += LaneCount) {
+            inverse_of(i);
+        }
+
+        double max_error = 0.0;
+        double total_error = 0.0;
+        for (size_t i = 0; i < Samples; ++i) {
+            const double reference = 1.0f / std::sqrt(d2[i]);
+            const double error = std::abs(inverse[i] - reference) / reference;
+            max_error = std::max(max_error, error);
+            total_error += error;
+        }
+
+        std::vector<float> bx = x;
+        std::vector<float> by = y;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < Repeats; ++r) {
+            magnitude_of(bx.data(), by.data());
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - start
+        ).count();
+
+        os << name << ": max relative error " << max_error << ", mean " << total_error / Samples << ", "
+           << static_cast<double>(elapsed) / (Repeats * Samples) << "ns per magnitude\n";
+    };
+
+    const auto batch_inverse = [&]<SteeringMode Mode>() {
+        return [&](const size_t i) { inverse_sqrt<Mode>(Lanes::load(d2.data() + i)).store(inverse.data() + i); };
+    };
+
+    const auto batch_magnitude = [&]<SteeringMode Mode>() {
+        return [&](float *bx, float *by) { magnitude<Mode>(bx, by, Samples, Boid::maxSpeed); };
+    };
+
+    os << "Steering math over " << Samples << " vectors, " << LaneCount << " lanes:\n";
+    report(
+        "  scalar fastInverseSqrt",
+        [&](const size_t i) {
+            for (size_t l = i; l < i + LaneCount; ++l) { inverse[l] = fastInverseSqrt(d2[l]); }
+        },
+        [&](float *bx, float *by) {
+            for (size_t i = 0; i < Samples; ++i) {
+                const Vector result = ::magnitude(Vector {bx[i], by[i]}, Boid::maxSpeed);
+                bx[i] = result.x;
+                by[i] = result.y;
+            }
+        }
+    );
+    report(
+        "  batch fast",
+        batch_inverse.template operator()<SteeringMode::Fast>(),
+        batch_magnitude.template operator()<SteeringMode::Fast>()
+    );
+    report(
+        "  batch accurate",
+        batch_inverse.template operator()<SteeringMode::Accurate>(),
+        batch_magnitude.template operator()<SteeringMode::Accurate>()
+    );
+    report(
+        "  batch exact",
+        batch_inverse.template operator()<SteeringMode::Exact>(),
+        batch_magnitude.template operator()<SteeringMode::Exact>()
+    );
+    os << std::endl;
+}
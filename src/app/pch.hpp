@@ -3,19 +3,51 @@
 // STL
 #include <malloc.h>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <stdexcept>
 #include <iostream>
+#include <fstream>
 #include <optional>
 #include <functional>
 #include <variant>
 #include <iterator>
 #include <vector>
+#include <deque>
 #include <array>
 #include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <filesystem>
+#include <tuple>
 #include <utility>
+#include <memory>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 #include <chrono>
 #include <bitset>
+#include <bit>
+#include <random>
+
+// PLATFORM
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 // EXTERNAL
 #include <glad/glad.h>
@@ -29,7 +61,6 @@
 #include <glm/gtx/fast_square_root.hpp>
 #include <glm/gtx/norm.hpp>
 #include <lua/lua.hpp>
-#include <thread-pool/ThreadPool.hpp>
 
 // APPLICATION
 #include "Common.hpp"
@@ -5,9 +5,12 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <fstream>
+#include <initializer_list>
 #include <variant>
+#include <vector>
 
 namespace lwvl {
     class Buffer;
@@ -156,6 +159,7 @@ namespace lwvl {
             Array = GL_ARRAY_BUFFER,
             Element = GL_ELEMENT_ARRAY_BUFFER,
             Texture = GL_TEXTURE_BUFFER,
+            DrawIndirect = GL_DRAW_INDIRECT_BUFFER,
             //Uniform = GL_UNIFORM_BUFFER,
             Shader = GL_SHADER_STORAGE_BUFFER,
         };
@@ -192,6 +196,9 @@ namespace lwvl {
 
         void bind(IndexedTarget, GLuint) const;
 
+        // Bind only part of the buffer. Offsets have to meet the target's alignment.
+        void bind(IndexedTarget, GLuint, GLintptr offset, GLsizeiptr size) const;
+
         static void clear(Target);
 
         Buffer() = default;
@@ -234,10 +241,65 @@ namespace lwvl {
             glNamedBufferSubData(id(), offset, sizeof(*first) * (last - first), &(*first));
         }
 
-        //template<typename T>
-        //T* map(GLsizeiptr size, GLbitfield bits, GLintptr offset = 0) {
-        //    glMapNamedBufferRange(id(), offset, size, bits);
-        //}
+        // Map a range of buffer storage. For persistent maps the storage needs the same bits.
+        template<typename T>
+        T *map(GLsizeiptr size, GLbitfield bits, GLintptr offset = 0) {
+            return static_cast<T *>(glMapNamedBufferRange(id(), offset, size, bits));
+        }
+
+        void unmap();
+    };
+
+    /*
+     * Ring of persistently mapped regions for data that is rewritten every frame.
+     * . acquire() hands out the next region, waiting only if the GPU may still be reading it from a few frames back.
+     * . fence() a region once the draws that read it are submitted.
+     * . A request larger than a region grows the storage in place of stalling: a fresh buffer replaces the old one,
+     *   whose storage the driver frees once the GPU is done with it. Pointers from earlier acquires are gone then.
+     */
+    class StreamBuffer {
+    public:
+        struct Region {
+            void *data;
+            GLintptr offset;
+            GLsizei index;
+        };
+
+        // Readable regions sit in cached client memory and can be read back on the CPU, which write-only regions
+        // cannot. Drawing from them may be slower, so only ask for it when the CPU reads what it wrote.
+        explicit StreamBuffer(GLsizeiptr region_size = 0, GLsizei regions = 3, bool readable = false);
+
+        StreamBuffer(StreamBuffer const &) = delete;
+
+        StreamBuffer &operator=(StreamBuffer const &) = delete;
+
+        ~StreamBuffer();
+
+        Region acquire(GLsizeiptr size);
+
+        void fence(GLsizei region);
+
+        // Which region a pointer from acquire() lies in.
+        [[nodiscard]] GLsizei region_of(void const *) const;
+
+        [[nodiscard]] GLintptr offset(GLsizei region) const;
+
+        [[nodiscard]] Buffer const &buffer() const;
+
+    private:
+        void allocate(GLsizeiptr region_size);
+
+        void wait(GLsizei region);
+
+        void release_fences();
+
+        Buffer m_buffer;
+        char *m_data = nullptr;
+        GLsizeiptr m_region_size = 0;
+        GLsizei m_regions;
+        GLsizei m_current;
+        bool m_readable;
+        std::vector<GLsync> m_fences;
     };
 
     namespace debug {
@@ -340,6 +402,8 @@ namespace lwvl {
         explicit Framebuffer(int);
 
     public:
+        Framebuffer();
+
         [[nodiscard]] GLuint id() const;
 
         void bind();
@@ -511,11 +575,13 @@ namespace lwvl {
                 return m_offsite_id->id;
             }
 
-            explicit Shader(std::string const &source) {
-                const char *src = source.c_str();
+            // The source need not be null terminated, so it can point straight into a mapped file.
+            explicit Shader(std::string_view source) {
+                const char *src = source.data();
+                const auto length = static_cast<GLint>(source.size());
                 const GLuint so = id();
                 int result;
-                glShaderSource(so, 1, &src, nullptr);
+                glShaderSource(so, 1, &src, &length);
                 glCompileShader(so);
 
                 glGetShaderiv(so, GL_COMPILE_STATUS, &result);
@@ -619,7 +685,10 @@ namespace lwvl {
 
         void link(VertexShader const &vs, FragmentShader const &fs);
 
-        void link(std::string const &vertexSource, std::string const &fragmentSource);
+        // Compiles and links from source, or loads the binary cached for these sources if there is one.
+        void link(std::string_view vertexSource, std::string_view fragmentSource);
+
+        void link(std::string_view computeSource);
 
         void bind() const;
 
@@ -628,6 +697,31 @@ namespace lwvl {
         static int active();
     };
 
+    /*
+     * Program binaries on disk, so programs linked once are not compiled again by later runs.
+     * . Entries are keyed by the sources and the vendor, renderer and version strings, so a driver update or a
+     *   different GPU misses instead of loading a binary that was built for something else.
+     * . A binary the driver refuses is treated as a miss, the program is linked from source and the entry replaced.
+     * . Nothing is cached until directory() is given a path. Entries from older drivers are left for the user to clear.
+     */
+    class ProgramCache {
+    public:
+        // Empty turns the cache off. The directory is created on the first store.
+        static void directory(std::string path);
+
+        [[nodiscard]] static std::string const &directory();
+
+        // The entry name for a program built from sources on the current context.
+        [[nodiscard]] static std::string key(std::initializer_list<std::string_view> sources);
+
+        // True when the program was linked from the entry's binary. On a miss the program is asked to keep its
+        // binary retrievable, so it can be stored once it is linked from source.
+        static bool load(GLuint program, std::string const &key);
+
+        // Write a linked program's binary to the entry. Failures leave the cache as it was.
+        static void store(GLuint program, std::string const &key);
+    };
+
     class Uniform {
         GLint m_location = -1;
     public:
@@ -742,6 +836,20 @@ namespace lwvl {
         void drawArrays(PrimitiveMode mode, int count) const;
 
         void drawElements(PrimitiveMode mode, int count, ByteFormat type) const;
+
+        // Draw every command in a buffer of DrawElementsIndirectCommands with one call.
+        void multiDrawElementsIndirect(
+            PrimitiveMode mode, ByteFormat type, lwvl::Buffer const &commands, GLsizei count, GLintptr offset = 0
+        ) const;
+    };
+
+    // Layout the GL reads indirect element draws in. Shaders see the command's index as gl_DrawID.
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
     };
 
     struct Viewport {
@@ -22,6 +22,14 @@ void lwvl::Buffer::bind(lwvl::Buffer::IndexedTarget t, GLuint index) const {
     glBindBufferBase(static_cast<GLenum>(t), index, id());
 }
 
+void lwvl::Buffer::bind(lwvl::Buffer::IndexedTarget t, GLuint index, GLintptr offset, GLsizeiptr size) const {
+    glBindBufferRange(static_cast<GLenum>(t), index, id(), offset, size);
+}
+
 void lwvl::Buffer::clear(lwvl::Buffer::Target t) {
     glBindBuffer(static_cast<GLenum>(t), 0);
 }
+
+void lwvl::Buffer::unmap() {
+    glUnmapNamedBuffer(id());
+}
@@ -13,6 +13,8 @@ lwvl::Framebuffer::ID::~ID() {
 }
 
 
+lwvl::Framebuffer::Framebuffer() = default;
+
 lwvl::Framebuffer::Framebuffer(int id) : m_offsite_id(std::make_shared<const lwvl::Framebuffer::ID>(id)) {}
 
 
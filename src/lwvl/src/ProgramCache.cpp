@@ -0,0 +1,152 @@
+#include "lwvl/lwvl.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+
+// Marks files written by store(), in case the directory is shared with something else.
+constexpr uint32_t EntryMagic = 0x4250574c;  // "LWPB"
+
+struct EntryHeader {
+    uint32_t magic;
+    GLenum format;
+};
+
+static std::string &cache_directory() {
+    static std::string directory;
+    return directory;
+}
+
+static std::filesystem::path entry_path(std::string const &key) {
+    return std::filesystem::path(cache_directory()) / (key + ".bin");
+}
+
+// FNV-1a. A collision would hand the driver the binary of other sources, which 64 bits over a handful of shaders rule
+// out in practice.
+static void hash_bytes(uint64_t &hash, std::string_view bytes) {
+    for (const char c: bytes) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ull;
+    }
+
+    // Length as well, so moving text from one source into the next changes the key.
+    const uint64_t length = bytes.size();
+    for (size_t i = 0; i < sizeof(length); ++i) {
+        hash ^= (length >> (8 * i)) & 0xff;
+        hash *= 0x100000001b3ull;
+    }
+}
+
+static std::string_view gl_string(GLenum name) {
+    const auto *value = reinterpret_cast<const char *>(glGetString(name));
+    return value ? std::string_view(value) : std::string_view();
+}
+
+static bool binaries_supported() {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+void lwvl::ProgramCache::directory(std::string path) {
+    cache_directory() = std::move(path);
+}
+
+std::string const &lwvl::ProgramCache::directory() {
+    return cache_directory();
+}
+
+std::string lwvl::ProgramCache::key(std::initializer_list<std::string_view> sources) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash_bytes(hash, gl_string(GL_VENDOR));
+    hash_bytes(hash, gl_string(GL_RENDERER));
+    hash_bytes(hash, gl_string(GL_VERSION));
+    for (const std::string_view source: sources) {
+        hash_bytes(hash, source);
+    }
+
+    constexpr char digits[] = "0123456789abcdef";
+    std::string key(16, '0');
+    for (int i = 15; i >= 0; --i, hash >>= 4) {
+        key[i] = digits[hash & 0xf];
+    }
+    return key;
+}
+
+bool lwvl::ProgramCache::load(GLuint program, std::string const &key) {
+    if (cache_directory().empty() || !binaries_supported()) {
+        return false;
+    }
+
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    std::ifstream file(entry_path(key), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    EntryHeader header {};
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != EntryMagic) {
+        return false;
+    }
+
+    const std::vector<char> binary {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (binary.empty()) {
+        return false;
+    }
+
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    // A failed load leaves the program unlinked but usable, so the caller can still link it from source.
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+void lwvl::ProgramCache::store(GLuint program, std::string const &key) {
+    if (cache_directory().empty() || !binaries_supported()) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    EntryHeader header {EntryMagic, 0};
+    std::vector<char> binary(length);
+    glGetProgramBinary(program, length, &length, &header.format, binary.data());
+    if (length <= 0) {
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(cache_directory(), error);
+    if (error) {
+        return;
+    }
+
+    // Instances starting together may all miss and store the same entry. Each writes its own file and renames it
+    // over the entry, so a reader sees one whole binary or none.
+    const std::filesystem::path path = entry_path(key);
+    std::filesystem::path temporary = path;
+    temporary += "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+    }
+}
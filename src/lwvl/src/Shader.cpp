@@ -214,10 +214,30 @@ void lwvl::Program::link(const VertexShader &vs, const FragmentShader &fs) {
     glDetachShader(pid, fso);
 }
 
-void lwvl::Program::link(std::string const &vertexSource, std::string const &fragmentSource) {
+void lwvl::Program::link(std::string_view vertexSource, std::string_view fragmentSource) {
+    const std::string key = ProgramCache::key({vertexSource, fragmentSource});
+    if (ProgramCache::load(id(), key)) {
+        return;
+    }
+
     VertexShader vs(vertexSource);
     FragmentShader fs(fragmentSource);
     link(vs, fs);
+    ProgramCache::store(id(), key);
+}
+
+void lwvl::Program::link(std::string_view computeSource) {
+    const std::string key = ProgramCache::key({computeSource});
+    if (ProgramCache::load(id(), key)) {
+        return;
+    }
+
+    ComputeShader cs(computeSource);
+    const GLuint pid = id();
+    glAttachShader(pid, cs.id());
+    link();
+    glDetachShader(pid, cs.id());
+    ProgramCache::store(id(), key);
 }
 
 void lwvl::Program::bind() const {
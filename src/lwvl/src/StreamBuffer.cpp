@@ -0,0 +1,88 @@
+#include "lwvl/lwvl.hpp"
+
+#include <algorithm>
+
+// Offsets that suit vertex attributes, uniform blocks and shader storage on every implementation seen so far.
+constexpr GLsizeiptr RegionAlignment = 256;
+
+lwvl::StreamBuffer::StreamBuffer(GLsizeiptr region_size, GLsizei regions, bool readable) :
+    m_regions(regions), m_current(regions - 1), m_readable(readable), m_fences(regions, nullptr) {
+    if (region_size > 0) {
+        allocate(region_size);
+    }
+}
+
+lwvl::StreamBuffer::~StreamBuffer() {
+    release_fences();
+}
+
+lwvl::StreamBuffer::Region lwvl::StreamBuffer::acquire(GLsizeiptr size) {
+    if (size > m_region_size || !m_data) {
+        allocate(std::max(size, m_region_size * 2));
+    }
+
+    m_current = (m_current + 1) % m_regions;
+    wait(m_current);
+
+    const GLintptr region_offset = offset(m_current);
+    return {m_data + region_offset, region_offset, m_current};
+}
+
+void lwvl::StreamBuffer::fence(GLsizei region) {
+    GLsync &fence = m_fences[region];
+    if (fence) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLsizei lwvl::StreamBuffer::region_of(void const *pointer) const {
+    return static_cast<GLsizei>((static_cast<char const *>(pointer) - m_data) / m_region_size);
+}
+
+GLintptr lwvl::StreamBuffer::offset(GLsizei region) const {
+    return static_cast<GLintptr>(region) * m_region_size;
+}
+
+lwvl::Buffer const &lwvl::StreamBuffer::buffer() const {
+    return m_buffer;
+}
+
+void lwvl::StreamBuffer::allocate(GLsizeiptr region_size) {
+    // Nothing in the new storage is in flight, so the old fences mean nothing anymore.
+    release_fences();
+
+    m_region_size = std::max<GLsizeiptr>((region_size + RegionAlignment - 1) / RegionAlignment * RegionAlignment, RegionAlignment);
+    const GLsizeiptr size = m_region_size * m_regions;
+    GLbitfield bits = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    if (m_readable) {
+        bits |= GL_MAP_READ_BIT;
+    }
+
+    // Dropping the old buffer releases its ID. The driver keeps the storage alive for as long as the GPU uses it.
+    // Without client storage, write mappings tend to be uncached or write-combined memory that is slow to read.
+    m_buffer = Buffer();
+    m_buffer.store<char>(nullptr, size, m_readable ? bits | GL_CLIENT_STORAGE_BIT : bits);
+    m_data = m_buffer.map<char>(size, bits);
+    m_current = m_regions - 1;
+}
+
+void lwvl::StreamBuffer::wait(GLsizei region) {
+    GLsync &fence = m_fences[region];
+    if (!fence) {
+        return;
+    }
+
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void lwvl::StreamBuffer::release_fences() {
+    for (GLsync &fence: m_fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+}
@@ -105,3 +105,17 @@ void lwvl::VertexArray::drawElements(lwvl::PrimitiveMode mode, int count, lwvl::
     // Rebind the previous VAO
     glBindVertexArray(currentVAO);
 }
+
+void lwvl::VertexArray::multiDrawElementsIndirect(
+    lwvl::PrimitiveMode mode, lwvl::ByteFormat type, lwvl::Buffer const &commands, GLsizei count, GLintptr offset
+) const {
+    GLint currentVAO;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &currentVAO);
+    glBindVertexArray(id());
+    commands.bind(Buffer::Target::DrawIndirect);
+    glMultiDrawElementsIndirect(
+        static_cast<GLenum>(mode), static_cast<GLenum>(type), reinterpret_cast<void const *>(offset), count, 0
+    );
+    // Rebind the previous VAO
+    glBindVertexArray(currentVAO);
+}